@@ -19,13 +19,16 @@ public:
     }
 };
 
-class InternalAuroraException : public std::exception {
+// a script went over its context's heap limit
+class AuroraHeapLimitException : public AuroraException {
 public:
-    enum class Type {
-        BREAK, CONTINUE
-    };
-    Type type;
+    using AuroraException::AuroraException;
+};
 
-    explicit InternalAuroraException(Type type) : type(type){}
+// a script ran out of its context's instruction or time budget
+class AuroraBudgetException : public AuroraException {
+public:
+    using AuroraException::AuroraException;
 };
+
 #endif //AURORA_AURORA_EXCEPTION_H
@@ -6,29 +6,97 @@
 #define AURORA_AURORA_OBJ_H
 
 #include <variant>
+#include <atomic>
+#include <algorithm>
+#include <climits>
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <cmath>
 #include "instruction.h"
 #include "aurora_exception.h"
 
 struct AuroraObj;
 
+class AuroraMap;
+
+class AuroraRecord;
+
+struct AuroraIterator;
+
+// a record value, holding a counted reference to the record, so copies share it, see record.h
+class AuroraRecordRef {
+public:
+    explicit AuroraRecordRef(AuroraRecord *record) : record(record) {}
+
+    AuroraRecordRef(const AuroraRecordRef &other);
+
+    AuroraRecordRef(AuroraRecordRef &&other) noexcept: record(other.record) { other.record = nullptr; }
+
+    AuroraRecordRef &operator=(AuroraRecordRef other) noexcept {
+        std::swap(record, other.record);
+        return *this;
+    }
+
+    ~AuroraRecordRef();
+
+    [[nodiscard]] AuroraRecord *get() const { return record; }
+
+private:
+    AuroraRecord *record;
+};
+
 struct AuroraCodeUnit {
     std::vector<Instruction> instructions;
     std::vector<AuroraObj> constants;
+    // instructions in direct-threaded form, made by AuroraContext on first execution and null until
+    // then. Contexts on other threads may run the unit first too, so the code is published with a
+    // compare-and-swap. Copies start without it, since it points into the unit's own constants.
+    mutable std::atomic<const ThreadedInstruction *> threaded{nullptr};
+    // (first instruction, source line) for each run of instructions compiled from the same line
+    std::vector<std::pair<int, int>> lines;
+
+    AuroraCodeUnit() = default;
+
+    AuroraCodeUnit(const AuroraCodeUnit &other);
+
+    AuroraCodeUnit(AuroraCodeUnit &&other) noexcept;
+
+    AuroraCodeUnit &operator=(const AuroraCodeUnit &other);
+
+    AuroraCodeUnit &operator=(AuroraCodeUnit &&other) noexcept;
+
+    ~AuroraCodeUnit() { delete[] threaded.load(); }
 
     void emit(InstructionType type, int operand = 0) {
         instructions.push_back({type, operand});
     }
 
+    // instructions emitted from here on come from line
+    void markLine(int line) {
+        int pc = instructions.size();
+        if (!lines.empty() && lines.back().second == line) return;
+        if (!lines.empty() && lines.back().first == pc) lines.back().second = line;
+        else lines.emplace_back(pc, line);
+    }
+
+    [[nodiscard]] int lineAt(int pc) const {
+        auto it = std::upper_bound(lines.begin(), lines.end(), std::make_pair(pc, INT_MAX));
+        return it == lines.begin() ? 0 : std::prev(it)->second;
+    }
+
     int getConstantIndex(const AuroraObj &obj);
+
+    // appends without deduplication, so the objects get consecutive indices
+    int addConstants(std::initializer_list<AuroraObj> objs);
 };
 
 struct AuroraFunction {
     std::vector<std::string> parameters;
-    AuroraCodeUnit code;
+    // shared, so copying a function value doesn't copy its code and frames can point into it
+    std::shared_ptr<AuroraCodeUnit> code;
+    std::string name;
 };
 
 inline std::string variantIndexToString(size_t index) {
@@ -41,6 +109,9 @@ inline std::string variantIndexToString(size_t index) {
         case 5: return "code unit";
         case 6: return "null";
         case 7: return "native function";
+        case 8: return "map";
+        case 9: return "record";
+        case 10: return "iterator";
     }
     return "unknown";
 }
@@ -51,32 +122,152 @@ inline void guardType(size_t index, size_t expected) {
 
 typedef std::function<AuroraObj(std::vector<AuroraObj>)> AuroraNativeFunction;
 
+// The heap one context allocated while running and still has live, and the most it may have;
+// going over throws AuroraHeapLimitException.
+struct AuroraHeapAccount {
+    int64_t live = 0;
+    int64_t limit = INT64_MAX;
+};
+
+// heap allocations made creating or copying values, by variant index, counted while enabled.
+// Live bytes go down again as values are destroyed; buffers that move between values stay counted
+// once, since a move carries the buffer along without allocating. The totals are shared by every
+// thread, the live bytes checked against a limit are kept per context, in its account.
+struct AuroraAllocations {
+    // how many of stats, tracing, heap limits and reports want allocations counted
+    static inline std::atomic<int> enabled{0};
+    static constexpr size_t kinds = 11; // AuroraObj's variant alternatives
+    static inline std::atomic<uint64_t> counts[kinds]{};
+    static inline std::atomic<uint64_t> bytes[kinds]{};
+    static inline std::atomic<int64_t> live[kinds]{};
+    static inline std::atomic<int64_t> liveTotal{0};
+    // the account of the context running on this thread, null between slices
+    static inline thread_local AuroraHeapAccount *account = nullptr;
+    // remember which function and line allocated each live buffer, see heap.h; main thread only
+    static inline bool trackSites = false;
+
+    // checked on every copy and destruction of a value, so a relaxed load
+    static bool counting() { return enabled.load(std::memory_order_relaxed) != 0; }
+
+    // counts allocations while in scope, if on is set
+    struct Counting {
+        bool on;
+
+        explicit Counting(bool on) : on(on) { if (on) enabled++; }
+
+        Counting(const Counting &) = delete;
+
+        ~Counting() { if (on) enabled--; }
+    };
+
+    // the buffer a value owns and its size, {nullptr, 0} for values that don't allocate
+    static std::pair<const void *, size_t> buffer(const AuroraObj &obj);
+
+    // out of line and cold, so values destroyed and assigned in the dispatch loop stay small
+    [[gnu::cold]] static void record(const AuroraObj &obj);
+
+    [[gnu::cold]] static void release(const AuroraObj &obj);
+
+    // a buffer that values of the given kind share, like a map's table: copying the value doesn't
+    // allocate, so its owner records it when it's allocated and releases it when it's freed
+    [[gnu::cold]] static void record(size_t kind, const void *buffer, size_t size);
+
+    [[gnu::cold]] static void release(size_t kind, const void *buffer, size_t size);
+
+    static void recordSite(const void *buffer, size_t size, size_t kind);
+
+    static void releaseSite(const void *buffer);
+};
+
+// A list's elements. Lists of numbers made by range, list literals and read_numbers keep them
+// packed as doubles, in an eighth of the space values take; storing anything but a number in one
+// unpacks it into values for good. Either way it's the same list to scripts.
+class AuroraList {
+public:
+    AuroraList() = default;
+
+    AuroraList(std::vector<AuroraObj> values) : elements(std::move(values)) {}
+
+    explicit AuroraList(std::vector<double> numbers) : elements(std::move(numbers)) {}
+
+    [[nodiscard]] bool packed() const { return elements.index() == 1; }
+
+    [[nodiscard]] size_t size() const;
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    // a copy of element i
+    [[nodiscard]] AuroraObj operator[](size_t i) const;
+
+    // the elements of a packed list
+    [[nodiscard]] const std::vector<double> &numbers() const { return *std::get_if<std::vector<double>>(&elements); }
+
+    // the elements of a list that isn't packed, like the compiler's operand lists
+    [[nodiscard]] const std::vector<AuroraObj> &values() const { return std::get<std::vector<AuroraObj>>(elements); }
+
+    // the elements as values, unpacking the list if it's packed
+    std::vector<AuroraObj> &values();
+
+    // a copy of the elements as values
+    [[nodiscard]] std::vector<AuroraObj> toVector() const;
+
+    // throws std::out_of_range past the end, like std::vector::at
+    void set(size_t i, AuroraObj value);
+
+    void push_back(AuroraObj value);
+
+    void pop_back();
+
+    // the buffer the elements are in, and its size in bytes, for heap accounting
+    [[nodiscard]] std::pair<const void *, size_t> buffer() const;
+
+    bool operator==(const AuroraList &other) const;
+
+private:
+    std::variant<std::vector<AuroraObj>, std::vector<double>> elements;
+};
+
 struct AuroraObj {
-    std::variant<double, std::string, bool, std::vector<AuroraObj>, AuroraFunction, AuroraCodeUnit, std::monostate, AuroraNativeFunction> value{};
+    std::variant<double, std::string, bool, AuroraList, AuroraFunction, AuroraCodeUnit, std::monostate,
+                 AuroraNativeFunction, std::shared_ptr<AuroraMap>, AuroraRecordRef,
+                 std::shared_ptr<AuroraIterator>> value{};
 
     explicit AuroraObj() : value(std::monostate{}) {}
 
     explicit AuroraObj(double value) : value(value) {}
 
-    explicit AuroraObj(std::string value) : value(std::move(value)) {}
+    explicit AuroraObj(std::string value) : value(std::move(value)) { counted(); }
 
     explicit AuroraObj(bool value) : value(value) {}
 
-    explicit AuroraObj(std::vector<AuroraObj> value) : value(std::move(value)) {}
+    explicit AuroraObj(std::vector<AuroraObj> value) : value(AuroraList(std::move(value))) { counted(); }
+
+    explicit AuroraObj(AuroraList value) : value(std::move(value)) { counted(); }
+
+    explicit AuroraObj(AuroraFunction value) : value(std::move(value)) { counted(); }
 
-    explicit AuroraObj(AuroraFunction value) : value(std::move(value)) {}
+    explicit AuroraObj(AuroraCodeUnit value) : value(std::move(value)) { counted(); }
 
-    explicit AuroraObj(AuroraCodeUnit value) : value(std::move(value)) {}
+    AuroraObj(const AuroraObj &other) : value(other.value) { counted(); }
+
+    AuroraObj(AuroraObj &&other) = default;
 
     explicit AuroraObj(AuroraNativeFunction value) : value(std::move(value)) {}
 
+    // maps are shared, copies of the value see the same entries, see map.h
+    explicit AuroraObj(std::shared_ptr<AuroraMap> value) : value(std::move(value)) {}
+
+    explicit AuroraObj(AuroraRecordRef value) : value(std::move(value)) {}
+
+    explicit AuroraObj(std::shared_ptr<AuroraIterator> value) : value(std::move(value)) {}
+
     [[nodiscard]] double asDouble() const { guardType(value.index(), 0); return std::get<double>(value); }
 
     [[nodiscard]] std::string asString() const { guardType(value.index(), 1); return std::get<std::string>(value); }
 
     [[nodiscard]] bool asBool() const { guardType(value.index(), 2); return std::get<bool>(value); }
 
-    [[nodiscard]] std::vector<AuroraObj> asVector() const { guardType(value.index(), 3); return std::get<std::vector<AuroraObj>>(value); }
+    [[nodiscard]] std::vector<AuroraObj> asVector() const { guardType(value.index(), 3); return std::get<AuroraList>(value).toVector(); }
 
     [[nodiscard]] AuroraFunction asFunction() const { guardType(value.index(), 4); return std::get<AuroraFunction>(value); }
 
@@ -84,6 +275,19 @@ struct AuroraObj {
 
     [[nodiscard]] AuroraNativeFunction asNativeFunction() const { guardType(value.index(), 7); return std::get<AuroraNativeFunction>(value); }
 
+    // unchecked accessors, only valid where the type has already been proven
+    [[nodiscard]] double &asDoubleUnchecked() { return *std::get_if<double>(&value); }
+
+    [[nodiscard]] const std::string &asStringUnchecked() const { return *std::get_if<std::string>(&value); }
+
+    [[nodiscard]] bool asBoolUnchecked() const { return *std::get_if<bool>(&value); }
+
+    [[nodiscard]] const AuroraList &asListUnchecked() const { return *std::get_if<AuroraList>(&value); }
+
+    [[nodiscard]] const AuroraFunction &asFunctionUnchecked() const { return *std::get_if<AuroraFunction>(&value); }
+
+    [[nodiscard]] const AuroraNativeFunction &asNativeFunctionUnchecked() const { return *std::get_if<AuroraNativeFunction>(&value); }
+
     bool operator==(const AuroraObj &other) const {
         if (value.index() != other.value.index()) return false;
         switch (value.index()) {
@@ -94,60 +298,196 @@ struct AuroraObj {
             case 2:
                 return asBool() == other.asBool();
             case 3:
-                return asVector() == other.asVector();
+                return asListUnchecked() == other.asListUnchecked();
             case 4:
             case 5:
                 return false;
+            case 8:
+                // the same map, not an equal one
+                return std::get<8>(value) == std::get<8>(other.value);
+            case 9:
+                return std::get<9>(value).get() == std::get<9>(other.value).get();
+            case 10:
+                return std::get<10>(value) == std::get<10>(other.value);
             default:
                 throw AuroraException("Invalid AuroraObj type.");
         }
     }
 
     bool operator!=(const AuroraObj &other) const { return !(*this == other); }
-    AuroraObj& operator=(const AuroraObj& other) = default;
+    ~AuroraObj() {
+        if (__builtin_expect(AuroraAllocations::counting(), 0)) AuroraAllocations::release(*this);
+    }
 
-    [[nodiscard]] std::string string_representation() const {
-        switch (value.index()) {
-            case 0: {
-                std::string result = std::to_string(asDouble());
-                if (result.find('.') != std::string::npos) {
-                    while (result.back() == '0') result.pop_back();
-                    if (result.back() == '.') result.pop_back();
-                }
-                return result;
-            }
-            case 1:
-                return std::get<std::string>(value);
-            case 2:
-                return asBool() ? "true" : "false";
-            case 3: {
-                if (asVector().empty()) return "[]";
-                std::string result = "{";
-                for (const auto &obj: asVector()) {
-                    result += obj.string_representation() + ", ";
-                }
-                result.pop_back();
-                result.pop_back();
-                result += "}";
-                return result;
-            }
-            case 4:
-                return "function";
-            case 5:
-                return "code unit";
-            case 6:
-                return "null";
-            case 7:
-                return "native function";
-            default:
-                throw AuroraException("Invalid AuroraObj type.");
+    AuroraObj& operator=(const AuroraObj& other) {
+        if (__builtin_expect(AuroraAllocations::counting(), 0)) {
+            // copy first, so going over the heap limit leaves this value as it was
+            AuroraObj copy(other);
+            return *this = std::move(copy);
+        }
+        value = other.value;
+        return *this;
+    }
+
+    AuroraObj& operator=(AuroraObj&& other) noexcept {
+        if (__builtin_expect(AuroraAllocations::counting(), 0)) {
+            AuroraAllocations::release(*this);
+            value = std::move(other.value);
+            // a moved-to string may hand its old, already released buffer back to other
+            other.value.emplace<std::monostate>();
+            return *this;
         }
+        value = std::move(other.value);
+        return *this;
+    }
+
+    // appends string_representation's text to out, rendering nested lists in place, see format.cpp
+    void appendTo(std::string &out) const;
+
+    // the one-byte string c, from a table shared by indexing and iterating over strings
+    static const AuroraObj &character(unsigned char c);
+
+    [[nodiscard]] std::string string_representation() const {
+        std::string result;
+        appendTo(result);
+        return result;
+    }
+
+private:
+    void counted() const {
+        if (__builtin_expect(AuroraAllocations::counting(), 0)) AuroraAllocations::record(*this);
     }
 };
 
+static_assert(std::variant_size_v<decltype(AuroraObj::value)> == AuroraAllocations::kinds);
+
+inline const AuroraObj &AuroraObj::character(unsigned char c) {
+    // fits std::string's inline buffer, so copies never allocate either
+    static const std::vector<AuroraObj> table = [] {
+        std::vector<AuroraObj> table;
+        table.reserve(256);
+        for (int i = 0; i < 256; i++) table.emplace_back(std::string(1, (char) i));
+        return table;
+    }();
+    return table[c];
+}
+
+inline size_t AuroraList::size() const {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements)) return numbers->size();
+    return std::get_if<std::vector<AuroraObj>>(&elements)->size();
+}
+
+inline AuroraObj AuroraList::operator[](size_t i) const {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements)) return AuroraObj((*numbers)[i]);
+    return (*std::get_if<std::vector<AuroraObj>>(&elements))[i];
+}
+
+inline std::vector<AuroraObj> &AuroraList::values() {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements)) {
+        std::vector<AuroraObj> values;
+        values.reserve(numbers->size());
+        for (double number: *numbers) values.emplace_back(number);
+        elements = std::move(values);
+    }
+    return *std::get_if<std::vector<AuroraObj>>(&elements);
+}
+
+inline std::vector<AuroraObj> AuroraList::toVector() const {
+    if (!packed()) return values();
+    std::vector<AuroraObj> values;
+    values.reserve(size());
+    for (double number: numbers()) values.emplace_back(number);
+    return values;
+}
+
+inline void AuroraList::set(size_t i, AuroraObj value) {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements); numbers && value.value.index() == 0)
+        numbers->at(i) = std::get<double>(value.value);
+    else values().at(i) = std::move(value);
+}
+
+inline void AuroraList::push_back(AuroraObj value) {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements); numbers && value.value.index() == 0)
+        numbers->push_back(std::get<double>(value.value));
+    else values().push_back(std::move(value));
+}
+
+inline void AuroraList::pop_back() {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements)) numbers->pop_back();
+    else std::get_if<std::vector<AuroraObj>>(&elements)->pop_back();
+}
+
+inline std::pair<const void *, size_t> AuroraList::buffer() const {
+    if (auto numbers = std::get_if<std::vector<double>>(&elements))
+        return {numbers->data(), numbers->capacity() * sizeof(double)};
+    auto &values = *std::get_if<std::vector<AuroraObj>>(&elements);
+    return {values.data(), values.capacity() * sizeof(AuroraObj)};
+}
+
+inline bool AuroraList::operator==(const AuroraList &other) const {
+    if (packed() && other.packed()) return numbers() == other.numbers();
+    if (size() != other.size()) return false;
+    for (size_t i = 0; i < size(); i++) {
+        if ((*this)[i] != other[i]) return false;
+    }
+    return true;
+}
+
+inline std::pair<const void *, size_t> AuroraAllocations::buffer(const AuroraObj &obj) {
+    // the value's own buffers; elements and constants that are values count themselves
+    switch (obj.value.index()) {
+        case 1: {
+            auto &str = std::get<std::string>(obj.value);
+            if (str.capacity() <= std::string().capacity()) return {nullptr, 0};
+            return {str.data(), str.capacity() + 1};
+        }
+        case 3:
+            return obj.asListUnchecked().buffer();
+        case 4: {
+            auto &fn = std::get<AuroraFunction>(obj.value);
+            return {fn.parameters.data(), fn.parameters.capacity() * sizeof(std::string)};
+        }
+        case 5: {
+            // threaded code is a cache filled in later, so it isn't part of the value's size
+            auto &unit = std::get<AuroraCodeUnit>(obj.value);
+            return {unit.instructions.data(), unit.instructions.capacity() * sizeof(Instruction) +
+                                              unit.constants.capacity() * sizeof(AuroraObj) +
+                                              unit.lines.capacity() * sizeof(std::pair<int, int>)};
+        }
+        default:
+            return {nullptr, 0};
+    }
+}
+
+inline AuroraCodeUnit::AuroraCodeUnit(const AuroraCodeUnit &other)
+        : instructions(other.instructions), constants(other.constants), lines(other.lines) {}
+
+// the constants' buffer moves along, so the threaded code can too
+inline AuroraCodeUnit::AuroraCodeUnit(AuroraCodeUnit &&other) noexcept
+        : instructions(std::move(other.instructions)), constants(std::move(other.constants)),
+          threaded(other.threaded.exchange(nullptr)), lines(std::move(other.lines)) {}
+
+inline AuroraCodeUnit &AuroraCodeUnit::operator=(const AuroraCodeUnit &other) {
+    if (this == &other) return *this;
+    instructions = other.instructions;
+    constants = other.constants;
+    lines = other.lines;
+    delete[] threaded.exchange(nullptr);
+    return *this;
+}
+
+inline AuroraCodeUnit &AuroraCodeUnit::operator=(AuroraCodeUnit &&other) noexcept {
+    if (this == &other) return *this;
+    instructions = std::move(other.instructions);
+    constants = std::move(other.constants);
+    lines = std::move(other.lines);
+    delete[] threaded.exchange(other.threaded.exchange(nullptr));
+    return *this;
+}
+
 inline int AuroraCodeUnit::getConstantIndex(const AuroraObj &obj)  {
     if(obj.value.index() < 4) {
-        for (int i = 0; i < constants.size(); i++) {
+        for (int i = 0; i < (int) constants.size(); i++) {
             if(constants[i].value.index() == obj.value.index()) {
                 switch (constants[i].value.index()) {
                     case 0:
@@ -160,8 +500,7 @@ inline int AuroraCodeUnit::getConstantIndex(const AuroraObj &obj)  {
                         if (std::get<bool>(constants[i].value) == std::get<bool>(obj.value)) return i;
                         break;
                     case 3:
-                        if (std::get<std::vector<AuroraObj>>(constants[i].value) ==
-                            std::get<std::vector<AuroraObj>>(obj.value))
+                        if (std::get<AuroraList>(constants[i].value) == std::get<AuroraList>(obj.value))
                             return i;
                         break;
                     default:
@@ -174,12 +513,11 @@ inline int AuroraCodeUnit::getConstantIndex(const AuroraObj &obj)  {
     return constants.size() - 1;
 }
 
-class AuroraReturnException : public std::exception {
-public:
-    AuroraObj value;
-
-    explicit AuroraReturnException(AuroraObj value) : value(value){}
-};
+inline int AuroraCodeUnit::addConstants(std::initializer_list<AuroraObj> objs) {
+    int first = constants.size();
+    constants.insert(constants.end(), objs);
+    return first;
+}
 
 
 
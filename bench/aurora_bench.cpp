@@ -0,0 +1,208 @@
+#include "../context.h"
+#include "../std_lib.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifndef AURORA_BENCH_DIR
+#define AURORA_BENCH_DIR "bench"
+#endif
+
+// Runs every .au program in the corpus in its own process, so peak RSS is per program, with
+// warmup runs and repetitions. Prints median/p90/min wall time, VM instructions and peak RSS,
+// and optionally saves the results or compares them to a saved baseline.
+//
+// usage: aurora_bench [--dir d] [--warmup n] [--reps n] [--save f.json] [--baseline f.json]
+//                     [--threshold percent] [name...]
+
+struct BenchResult {
+    std::string name;
+    std::vector<double> times; // ms
+    uint64_t instructions = 0;
+    long peakRss = 0; // KB
+    std::string error;
+
+    [[nodiscard]] double percentile(double p) const {
+        auto sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min(sorted.size() - 1, (size_t)(p / 100 * sorted.size()))];
+    }
+};
+
+static void runChild(const std::string &source, int warmup, int reps, int fd) {
+    std::ostringstream out;
+    try {
+        std::vector<double> times;
+        uint64_t instructions = 0;
+        for (int i = 0; i < warmup + reps; i++) {
+            auto scriptGlobals = globals;
+            AuroraContext context(source, scriptGlobals);
+            // printing is still formatted, just not written anywhere
+            context.output.discard();
+            auto start = std::chrono::steady_clock::now();
+            context.run();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (i >= warmup) times.push_back(elapsed.count());
+            instructions = context.instructionsExecuted;
+        }
+        out << "ok " << instructions;
+        for (double time: times) out << " " << time;
+    } catch (AuroraException &e) {
+        out << "error " << e.what();
+    }
+    std::string result = out.str();
+    write(fd, result.data(), result.size());
+}
+
+static BenchResult runBenchmark(const std::filesystem::path &path, int warmup, int reps) {
+    BenchResult result;
+    result.name = path.stem().string();
+    std::ifstream file(path);
+    std::stringstream source;
+    source << file.rdbuf();
+    int fds[2];
+    if (pipe(fds) != 0) throw std::runtime_error("pipe failed");
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        runChild(source.str(), warmup, reps, fds[1]);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string output;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof buffer)) > 0) output.append(buffer, count);
+    close(fds[0]);
+    int status;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    result.peakRss = usage.ru_maxrss;
+    std::istringstream in(output);
+    std::string kind;
+    in >> kind;
+    if (kind == "ok") {
+        in >> result.instructions;
+        double time;
+        while (in >> time) result.times.push_back(time);
+    } else if (kind == "error") {
+        std::getline(in >> std::ws, result.error);
+    } else {
+        result.error = "crashed";
+    }
+    return result;
+}
+
+static void writeJson(std::ostream &out, const std::vector<BenchResult> &results) {
+    out << "{";
+    bool first = true;
+    for (const auto &result: results) {
+        if (!result.error.empty()) continue;
+        out << (first ? "\n" : ",\n") << "  \"" << result.name << "\": {\"median_ms\": " << result.percentile(50) << ", \"p90_ms\": "
+            << result.percentile(90) << ", \"min_ms\": " << result.percentile(0) << ", \"instructions\": "
+            << result.instructions << ", \"peak_rss_kb\": " << result.peakRss << "}";
+        first = false;
+    }
+    out << "\n}\n";
+}
+
+// median_ms of each benchmark in a file written by writeJson
+static std::unordered_map<std::string, double> readBaseline(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("Could not read baseline " + path);
+    std::unordered_map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(file, line)) {
+        auto nameStart = line.find('"'), median = line.find("\"median_ms\":");
+        if (nameStart == std::string::npos || median == std::string::npos) continue;
+        auto nameEnd = line.find('"', nameStart + 1);
+        baseline[line.substr(nameStart + 1, nameEnd - nameStart - 1)] = std::stod(line.substr(median + 12));
+    }
+    return baseline;
+}
+
+int main(int argc, char **argv) {
+#ifdef __GLIBC__
+    // same allocator tuning as the aurora binary
+    mallopt(M_MMAP_THRESHOLD, 32 << 20);
+    mallopt(M_TRIM_THRESHOLD, 64 << 20);
+#endif
+    std::string dir = AURORA_BENCH_DIR, save, baselinePath;
+    int warmup = 1, reps = 5;
+    double threshold = 10;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--dir") dir = value();
+        else if (arg == "--warmup") warmup = std::stoi(value());
+        else if (arg == "--reps") reps = std::max(1, std::stoi(value()));
+        else if (arg == "--save") save = value();
+        else if (arg == "--baseline") baselinePath = value();
+        else if (arg == "--threshold") threshold = std::stod(value());
+        else names.push_back(arg);
+    }
+
+    std::vector<std::filesystem::path> programs;
+    for (const auto &entry: std::filesystem::directory_iterator(dir)) {
+        auto stem = entry.path().stem().string();
+        if (entry.path().extension() != ".au") continue;
+        if (!names.empty() && std::find(names.begin(), names.end(), stem) == names.end()) continue;
+        programs.push_back(entry.path());
+    }
+    std::sort(programs.begin(), programs.end());
+
+    std::unordered_map<std::string, double> baseline;
+    if (!baselinePath.empty()) baseline = readBaseline(baselinePath);
+
+    std::vector<BenchResult> results;
+    bool failed = false;
+    std::cout << std::left << std::setw(12) << "program" << std::right << std::setw(12) << "median ms"
+              << std::setw(12) << "p90 ms" << std::setw(12) << "min ms" << std::setw(14) << "instructions"
+              << std::setw(12) << "peak RSS" << (baseline.empty() ? "" : "    vs baseline") << "\n";
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto &program: programs) {
+        auto result = runBenchmark(program, warmup, reps);
+        results.push_back(result);
+        std::cout << std::left << std::setw(12) << result.name << std::right;
+        if (!result.error.empty()) {
+            std::cout << "  " << result.error << "\n";
+            failed = true;
+            continue;
+        }
+        std::cout << std::setw(12) << result.percentile(50) << std::setw(12) << result.percentile(90)
+                  << std::setw(12) << result.percentile(0) << std::setw(14) << result.instructions
+                  << std::setw(9) << result.peakRss << " KB";
+        auto it = baseline.find(result.name);
+        if (it != baseline.end()) {
+            double change = (result.percentile(50) / it->second - 1) * 100;
+            std::cout << std::showpos << std::setw(14) << change << "%" << std::noshowpos;
+            if (change > threshold) {
+                std::cout << "  REGRESSION";
+                failed = true;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    if (!save.empty()) {
+        std::ofstream out(save);
+        writeJson(out, results);
+    }
+    return failed ? 1 : 0;
+}
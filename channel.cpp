@@ -0,0 +1,148 @@
+#include "channel.h"
+#include "context.h"
+#include "map.h"
+#include "record.h"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+    struct Channel {
+        std::mutex mutex;
+        std::deque<AuroraObj> values;
+        std::deque<AuroraChannel::Receiver> receivers;
+    };
+
+    // never destroyed, contexts in static objects may still forget themselves during exit
+    std::mutex &registryMutex = *new std::mutex;
+    auto &channels = *new std::unordered_map<size_t, std::shared_ptr<Channel>>;
+    size_t nextChannel = 0;
+
+    std::shared_ptr<Channel> find(size_t id) {
+        std::lock_guard lock(registryMutex);
+        auto it = channels.find(id);
+        if (it == channels.end()) throw AuroraException("No open channel " + std::to_string(id) + ".");
+        return it->second;
+    }
+
+    // replaces the maps and records in value with copies, throwing if there's anything in it that
+    // isn't data. One reached twice is copied once, so those holding themselves keep the cycle.
+    void makeSendable(AuroraObj &value, std::unordered_map<const void *, AuroraObj> &copies) {
+        switch (value.value.index()) {
+            case 0:
+            case 1:
+            case 2:
+            case 6:
+                return;
+            case 3:
+                // packed lists hold only numbers
+                if (!value.asListUnchecked().packed())
+                    for (auto &element: std::get<AuroraList>(value.value).values()) makeSendable(element, copies);
+                return;
+            case 8: {
+                auto &map = AuroraMap::from(value);
+                auto found = copies.find(&map);
+                if (found != copies.end()) {
+                    value = found->second;
+                    return;
+                }
+                AuroraObj copy = AuroraMap::make();
+                copies.emplace(&map, copy);
+                auto &entries = AuroraMap::from(copy);
+                auto keys = map.keys(), values = map.values();
+                for (size_t i = 0; i < keys.size(); i++) {
+                    makeSendable(values[i], copies);
+                    entries.set(keys[i], std::move(values[i]));
+                }
+                value = std::move(copy);
+                return;
+            }
+            case 9: {
+                auto &record = AuroraRecord::from(value);
+                auto found = copies.find(&record);
+                if (found != copies.end()) {
+                    value = found->second;
+                    return;
+                }
+                AuroraObj copy = AuroraRecord::copy(record);
+                copies.emplace(&record, copy);
+                auto &fields = AuroraRecord::from(copy);
+                auto &ids = record.type().ids;
+                for (size_t i = 0; i < ids.size(); i++) makeSendable(fields.field(ids[i], (int) i), copies);
+                value = std::move(copy);
+                return;
+            }
+            default:
+                throw AuroraException("Can't send " + variantIndexToString(value.value.index()) +
+                                      "s over a channel, only data.");
+        }
+    }
+}
+
+size_t AuroraChannel::open() {
+    std::lock_guard lock(registryMutex);
+    channels.emplace(nextChannel, std::make_shared<Channel>());
+    return nextChannel++;
+}
+
+void AuroraChannel::send(size_t channel, AuroraObj value) {
+    std::unordered_map<const void *, AuroraObj> copies;
+    makeSendable(value, copies);
+    auto found = find(channel);
+    // waking under the channel's lock keeps the receiver's context from being forgotten meanwhile
+    std::lock_guard lock(found->mutex);
+    if (found->receivers.empty()) {
+        found->values.push_back(std::move(value));
+        return;
+    }
+    auto receiver = found->receivers.front();
+    found->receivers.pop_front();
+    receiver.context->wake(receiver.task, std::move(value));
+}
+
+std::optional<AuroraObj> AuroraChannel::receive(size_t channel, Receiver receiver) {
+    auto found = find(channel);
+    std::lock_guard lock(found->mutex);
+    if (found->values.empty()) {
+        found->receivers.push_back(receiver);
+        return std::nullopt;
+    }
+    AuroraObj value = std::move(found->values.front());
+    found->values.pop_front();
+    return value;
+}
+
+std::optional<AuroraObj> AuroraChannel::poll(size_t channel) {
+    auto found = find(channel);
+    std::lock_guard lock(found->mutex);
+    if (found->values.empty()) return std::nullopt;
+    AuroraObj value = std::move(found->values.front());
+    found->values.pop_front();
+    return value;
+}
+
+void AuroraChannel::close(size_t channel) {
+    std::shared_ptr<Channel> found;
+    {
+        std::lock_guard lock(registryMutex);
+        auto it = channels.find(channel);
+        if (it == channels.end()) throw AuroraException("No open channel " + std::to_string(channel) + ".");
+        found = std::move(it->second);
+        channels.erase(it);
+    }
+    std::lock_guard lock(found->mutex);
+    found->values.clear();
+    for (auto &receiver: found->receivers) receiver.context->wake(receiver.task, AuroraObj());
+    found->receivers.clear();
+}
+
+void AuroraChannel::forget(const AuroraContext *context) {
+    std::lock_guard lock(registryMutex);
+    for (auto &[id, channel]: channels) {
+        std::lock_guard channelLock(channel->mutex);
+        auto &receivers = channel->receivers;
+        receivers.erase(std::remove_if(receivers.begin(), receivers.end(), [&](const Receiver &receiver) {
+            return receiver.context == context;
+        }), receivers.end());
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef AURORA_CHANNEL_H
+#define AURORA_CHANNEL_H
+
+#include <optional>
+#include "aurora_obj.h"
+
+class AuroraContext;
+
+// Unbounded queues of values between tasks, by id. The tasks may belong to different contexts
+// running on different threads, and hosts may send from any thread, so every operation locks.
+// Only data crosses a channel: functions share code that isn't safe to run on two threads at once.
+// Maps and records are copied on the way, so the receiver never writes to the sender's.
+struct AuroraChannel {
+    struct Receiver {
+        AuroraContext *context;
+        size_t task;
+    };
+
+    static size_t open();
+
+    // hands value to the longest waiting receiver, or queues it
+    static void send(size_t channel, AuroraObj value);
+
+    // the next queued value, or nothing, in which case receiver is woken with the next one sent
+    static std::optional<AuroraObj> receive(size_t channel, Receiver receiver);
+
+    // the next queued value, if any, for hosts that can't wait
+    static std::optional<AuroraObj> poll(size_t channel);
+
+    // drops queued values and wakes every waiting receiver with null
+    static void close(size_t channel);
+
+    // stops waking receivers of context, which is going away
+    static void forget(const AuroraContext *context);
+};
+
+#endif //AURORA_CHANNEL_H
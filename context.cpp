@@ -3,7 +3,15 @@
 //
 
 #include "context.h"
+#include "type_inference.h"
+#include "map.h"
+#include "record.h"
+#ifdef AURORA_OPCODE_STATS
+#include "opcode_stats.h"
+#endif
 #include <iostream>
+#include <fstream>
+#include <chrono>
 #include <list>
 
 std::string tokenTypeToString(TokenType type) {
@@ -94,6 +102,10 @@ std::string tokenTypeToString(TokenType type) {
             return "MODULO_ASSIGN";
         case TokenType::ARROW:
             return "ARROW";
+        case TokenType::DOT:
+            return "DOT";
+        case TokenType::STRUCT:
+            return "STRUCT";
         case TokenType::EOF_:
             return "EOF";
     }
@@ -104,12 +116,395 @@ double dmod(double x, double y) {
     return x - (int) (x / y) * y;
 }
 
+Token AuroraContext::nextToken() {
+    tokenCount++;
+    if (!stats) return scanner.nextToken();
+    auto start = std::chrono::steady_clock::now();
+    Token token = scanner.nextToken();
+    stats->lexMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return token;
+}
+
+// set by runSlice, the only way into the dispatch loop
+static thread_local AuroraContext *activeContext = nullptr;
+
 void AuroraContext::run() {
+    using clock = std::chrono::steady_clock;
+    auto since = [](clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    };
+    // stats count what compiling allocates too, runSlice counts what each slice does
+    AuroraAllocations::Counting counting(stats != nullptr);
+    static const std::string compilePhase = "compile", inferencePhase = "type inference", executePhase = "execute";
+    if (tracer) tracer->begin(compilePhase, "phase");
+    auto start = clock::now();
     while (current.type != TokenType::EOF_) {
         statement();
     }
     currentCodeUnit.emit(InstructionType::END);
-    execute(currentCodeUnit);
+    if (tracer) tracer->end();
+    if (stats) {
+        stats->compileMs += since(start);
+        stats->countCode(currentCodeUnit);
+    }
+    start = clock::now();
+    if (inferTypes) {
+        if (tracer) tracer->begin(inferencePhase, "phase");
+        AuroraTypeInference inference(globals);
+        inference.run(currentCodeUnit);
+        if (reportDynamicSites) inference.report(std::cerr);
+        if (tracer) tracer->end();
+    }
+    if (stats) {
+        stats->inferenceMs += since(start);
+        stats->tokens += tokenCount;
+    }
+    if (tracer) tracer->registerNatives(globals);
+    runSlice(false);
+}
+
+bool AuroraContext::resume() {
+    if (!suspended() && !blocked()) throw AuroraException("No suspended script to resume.");
+    runSlice(true);
+    return !suspended();
+}
+
+void AuroraContext::runSlice(bool resuming) {
+    using clock = std::chrono::steady_clock;
+    static const std::string executePhase = "execute";
+    auto start = clock::now();
+    uint64_t calls = executeCalls, natives = nativeCalls;
+    // the limit counts what the script allocates, not what was live before it started
+    heap.limit = heapLimit > 0 ? heapLimit : INT64_MAX;
+    AuroraAllocations::Counting counting(heapLimit > 0 || stats);
+    AuroraHeapAccount *outerAccount = AuroraAllocations::account;
+    AuroraAllocations::account = &heap;
+    // sample() moves the allocation site along, so poll it from the first instruction
+    if (AuroraAllocations::trackSites) auroraSampleRequested = 1;
+    if (perfCounters) perfCounters->start();
+    if (tracer) tracer->begin(executePhase, "phase");
+    size_t traceDepth = tracer ? tracer->depth() : 0;
+    startBudget();
+    AuroraContext *outer = activeContext;
+    activeContext = this;
+    auto stop = [&]() {
+        activeContext = outer;
+        output.finishRun();
+        // calls still running when a slice suspends are closed, and reopened by the next
+        if (tracer) {
+            tracer->unwind(traceDepth);
+            tracer->end();
+        }
+        if (perfCounters) perfCounters->stop();
+        AuroraAllocations::account = outerAccount;
+        if (!stats) return;
+        stats->executeMs += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        stats->executeCalls += executeCalls - calls;
+        stats->nativeCalls += nativeCalls - natives;
+    };
+    try {
+        schedule(resuming, traceDepth);
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+}
+
+AuroraContext &AuroraContext::running() {
+    if (!activeContext) throw AuroraException("Tasks and channels need a running script.");
+    return *activeContext;
+}
+
+void AuroraContext::schedule(bool resuming, size_t traceDepth) {
+    auto enterTask = [&]() {
+        // spans of the previous task's calls don't belong on this one's timeline
+        if (tracer) {
+            tracer->unwind(traceDepth);
+            traceFrames();
+        }
+        auto at = *suspendedAt;
+        suspendedAt.reset();
+        pause = Pause::NONE;
+        lastResult = enter(0, at.first, at.second);
+    };
+    if (!resuming) {
+        pause = Pause::NONE;
+        lastResult = execute(currentCodeUnit);
+    } else if (runningTask != noTask) enterTask();
+    while (!tasks.empty() && pause != Pause::BUDGET) {
+        if (runningTask != noTask) {
+            if (!suspendedAt) finishTask(runningTask, lastResult);
+            else if (pause == Pause::YIELD) readyTasks.push_back(runningTask);
+            // blocked tasks are made ready again by whatever they're waiting on
+            swapTask(*tasks[runningTask]);
+            runningTask = noTask;
+        }
+        {
+            std::lock_guard lock(wakeMutex);
+            for (auto &[task, value]: wakeups) {
+                tasks[task]->stack.back() = std::move(value);
+                readyTasks.push_back(task);
+            }
+            wakeups.clear();
+        }
+        if (liveTasks == 0) {
+            tasks.clear();
+            runningTask = 0;
+            return;
+        }
+        if (readyTasks.empty()) return;
+        runningTask = readyTasks.front();
+        readyTasks.pop_front();
+        swapTask(*tasks[runningTask]);
+        enterTask();
+    }
+}
+
+void AuroraContext::traceFrames() {
+    static const std::string anonymous = "<anonymous>";
+    for (auto &frame: frames) {
+        if (frame.type != AuroraFrame::Type::CALL) continue;
+        auto it = functionNames.find(frame.unit);
+        tracer->begin(it == functionNames.end() ? anonymous : it->second, "function");
+    }
+}
+
+void AuroraContext::swapTask(AuroraTask &task) {
+    std::swap(frames, task.frames);
+    std::swap(stack, task.stack);
+    std::swap(locals, task.locals);
+    std::swap(callBase, task.callBase);
+    std::swap(callDepth, task.callDepth);
+    std::swap(suspendedAt, task.suspendedAt);
+}
+
+void AuroraContext::finishTask(size_t task, const AuroraObj &result) {
+    auto &finished = *tasks[task];
+    finished.finished = true;
+    finished.result = result;
+    liveTasks--;
+    for (size_t waiting: finished.awaiting) {
+        tasks[waiting]->stack.back() = result;
+        readyTasks.push_back(waiting);
+    }
+    finished.awaiting.clear();
+}
+
+void AuroraContext::ensureTasks() {
+    if (!tasks.empty()) return;
+    tasks.push_back(std::make_unique<AuroraTask>());
+    runningTask = 0;
+    liveTasks = 1;
+}
+
+size_t AuroraContext::taskArgument(const std::vector<AuroraObj> &args) const {
+    if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+    guardType(args[0].value.index(), 0);
+    double id = args[0].asDouble();
+    if (id < 0 || id >= tasks.size() || id != (size_t) id) throw AuroraException("No task " + args[0].string_representation() + ".");
+    return id;
+}
+
+AuroraObj AuroraContext::spawn(const std::vector<AuroraObj> &args) {
+    if (args.empty()) throw AuroraException("Expected at least 1 argument, got 0.");
+    if (args[0].value.index() != 4 && args[0].value.index() != 7)
+        throw AuroraException("Expected function, got " + variantIndexToString(args[0].value.index()) + ".");
+    ensureTasks();
+    auto task = std::make_unique<AuroraTask>();
+    task->entry.emit(InstructionType::CALL, (int) args.size() - 1);
+    task->entry.emit(InstructionType::RET);
+    task->stack = args;
+    task->frames.push_back({AuroraFrame::Type::BLOCK, &task->entry, -1, 0, 0});
+    task->suspendedAt.emplace(0, 0);
+    readyTasks.push_back(tasks.size());
+    tasks.push_back(std::move(task));
+    liveTasks++;
+    // start slicing between tasks straight away
+    budgetUsed += budgetSlice - budgetCountdown;
+    reloadBudget();
+    return AuroraObj((double) (tasks.size() - 1));
+}
+
+AuroraObj AuroraContext::await(const std::vector<AuroraObj> &args) {
+    if (activeGenerator) throw AuroraException("Generators can't block.");
+    ensureTasks();
+    size_t task = taskArgument(args);
+    if (tasks[task]->finished) return tasks[task]->result;
+    if (task == runningTask) throw AuroraException("A task can't await itself.");
+    tasks[task]->awaiting.push_back(runningTask);
+    pause = Pause::BLOCK;
+    return AuroraObj();
+}
+
+AuroraObj AuroraContext::yield(const std::vector<AuroraObj> &args) {
+    if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+    // a generator runs on the frames of whatever pulled from it, which has to get its element back
+    if (activeGenerator) throw AuroraException("Generators can't yield to other tasks, only emit values.");
+    if (liveTasks > 1) pause = Pause::YIELD;
+    return AuroraObj();
+}
+
+AuroraObj AuroraContext::emit(const std::vector<AuroraObj> &args) {
+    if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+    if (!activeGenerator) throw AuroraException("Only generators can emit values.");
+    activeGenerator->emitted = args[0];
+    pause = Pause::EMIT;
+    return AuroraObj();
+}
+
+AuroraObj AuroraContext::generator(const std::vector<AuroraObj> &args) {
+    if (args.empty()) throw AuroraException("Expected at least 1 argument, got 0.");
+    if (args[0].value.index() != 4 && args[0].value.index() != 7)
+        throw AuroraException("Expected function, got " + variantIndexToString(args[0].value.index()) + ".");
+    // nothing runs until the first element is pulled
+    auto generator = std::make_shared<AuroraGenerator>();
+    generator->context = this;
+    auto &state = generator->state;
+    state.entry.emit(InstructionType::CALL, (int) args.size() - 1);
+    state.entry.emit(InstructionType::RET);
+    state.stack = args;
+    state.frames.push_back({AuroraFrame::Type::BLOCK, &state.entry, -1, 0, 0});
+    state.suspendedAt.emplace(0, 0);
+    return AuroraIterator::make(std::move(generator));
+}
+
+bool AuroraGenerator::next(AuroraObj &out) {
+    return context->resumeGenerator(*this, out);
+}
+
+bool AuroraContext::resumeGenerator(AuroraGenerator &generator, AuroraObj &out) {
+    if (generator.finished) return false;
+    if (generator.running) throw AuroraException("Generator is already running.");
+    generator.running = true;
+    AuroraGenerator *outer = activeGenerator;
+    activeGenerator = &generator;
+    size_t traceDepth = tracer ? tracer->depth() : 0;
+    swapTask(generator.state);
+    if (tracer) traceFrames();
+    auto handBack = [&]() {
+        if (tracer) tracer->unwind(traceDepth);
+        swapTask(generator.state);
+        activeGenerator = outer;
+        generator.running = false;
+        pause = Pause::NONE;
+    };
+    auto at = *suspendedAt;
+    suspendedAt.reset();
+    pause = Pause::NONE;
+    try {
+        enter(0, at.first, at.second);
+    } catch (...) {
+        generator.finished = true;
+        handBack();
+        throw;
+    }
+    bool emitted = pause == Pause::EMIT;
+    handBack();
+    if (!emitted) {
+        // returned, drop its frames and whatever they held
+        generator.finished = true;
+        generator.state.stack.clear();
+        generator.state.locals.clear();
+        generator.state.frames.clear();
+        return false;
+    }
+    out = std::move(generator.emitted);
+    return true;
+}
+
+AuroraObj AuroraContext::call(const AuroraObj &fn, const std::vector<AuroraObj> &args) {
+    if (fn.value.index() == 7) {
+        nativeCalls++;
+        return fn.asNativeFunctionUnchecked()(args);
+    }
+    if (fn.value.index() == 10) return AuroraIterator::call(fn, args.size());
+    guardType(fn.value.index(), 4);
+    auto &entry = callEntries[(int) args.size()];
+    if (!entry) {
+        entry = std::make_unique<AuroraCodeUnit>();
+        entry->emit(InstructionType::CALL, (int) args.size());
+        entry->emit(InstructionType::RET);
+    }
+    size_t base = frames.size(), stackBase = stack.size(), localsBase = locals.size();
+    stack.push_back(fn);
+    stack.insert(stack.end(), args.begin(), args.end());
+    pushFrame(AuroraFrame::Type::BLOCK, entry.get());
+    return enter(base, stackBase, localsBase);
+}
+
+AuroraObj AuroraContext::receive(size_t channel) {
+    if (activeGenerator) throw AuroraException("Generators can't block.");
+    ensureTasks();
+    auto value = AuroraChannel::receive(channel, {this, runningTask});
+    if (value) return std::move(*value);
+    pause = Pause::BLOCK;
+    return AuroraObj();
+}
+
+void AuroraContext::wake(size_t task, AuroraObj value) {
+    std::function<void()> notify;
+    {
+        std::lock_guard lock(wakeMutex);
+        wakeups.emplace_back(task, std::move(value));
+        if (!parked) return;
+        parked = false;
+        notify = onWake;
+    }
+    if (notify) notify();
+}
+
+bool AuroraContext::park() {
+    std::lock_guard lock(wakeMutex);
+    if (!wakeups.empty()) return false;
+    parked = true;
+    return true;
+}
+
+void AuroraContext::startBudget() {
+    budgetUsed = 0;
+    budgetCountdown = budgetSlice = INT64_MAX;
+    if (timeBudget.count() > 0) deadline = std::chrono::steady_clock::now() + timeBudget;
+    reloadBudget();
+}
+
+void AuroraContext::reloadBudget() {
+    budgetSlice = INT64_MAX;
+    if (instructionBudget > 0) budgetSlice = (int64_t) (instructionBudget - budgetUsed);
+    if (timeBudget.count() > 0) budgetSlice = std::min<int64_t>(budgetSlice, clockInterval);
+    if (liveTasks > 1) budgetSlice = std::min(budgetSlice, taskSlice);
+    budgetCountdown = budgetSlice;
+}
+
+bool AuroraContext::budgetSpent(size_t base) {
+    // checks are only this slow every so often, see budgetCountdown
+    budgetUsed += budgetSlice - budgetCountdown;
+    bool outOfInstructions = instructionBudget > 0 && budgetUsed >= instructionBudget;
+    bool outOfTime = timeBudget.count() > 0 && std::chrono::steady_clock::now() >= deadline;
+    // only the script's own frames can suspend, not those under a native call or in a generator
+    bool nested = base != 0 || activeGenerator;
+    if (outOfInstructions || outOfTime) {
+        if (!yieldOnBudget) {
+            throw AuroraBudgetException(outOfTime ? "Time budget of " + std::to_string(timeBudget.count() / 1000000) +
+                                                    " ms exceeded."
+                                                  : "Instruction budget of " + std::to_string(instructionBudget) +
+                                                    " exceeded.");
+        }
+        if (nested) {
+            // check again soon, and suspend once back out
+            budgetCountdown = budgetSlice = clockInterval;
+            return false;
+        }
+        pause = Pause::BUDGET;
+        return true;
+    }
+    reloadBudget();
+    // other tasks get their turn every taskSlice instructions
+    if (liveTasks > 1 && !nested) {
+        pause = Pause::YIELD;
+        return true;
+    }
+    return false;
 }
 
 int AuroraContext::exprList() {
@@ -125,11 +520,11 @@ int AuroraContext::exprList() {
 
 Token AuroraContext::eat(TokenType type) {
     if (ignoreNewlines) {
-        while (peek(TokenType::NEWLINE)) current = scanner.nextToken();
+        while (peek(TokenType::NEWLINE)) current = nextToken();
     }
     if (current.type == type) {
         Token token = current;
-        current = scanner.nextToken();
+        current = nextToken();
         return token;
     }
     throw AuroraException(
@@ -193,18 +588,30 @@ void AuroraContext::primary() {
             bool prev = ignoreNewlines;
             ignoreNewlines = true;
             int count = 0;
-            if (!peek(TokenType::RIGHT_BRACE)) {
+            // {->} is the empty map, {k -> v, ...} a map, anything else a list
+            bool map = peek(TokenType::ARROW);
+            if (map) eat(TokenType::ARROW);
+            else if (!peek(TokenType::RIGHT_BRACE)) {
                 expression();
+                map = peek(TokenType::ARROW);
+                if (map) {
+                    eat(TokenType::ARROW);
+                    expression();
+                }
                 count++;
                 while (peek(TokenType::COMMA) || peek(TokenType::NEWLINE)) {
                     eat(TokenType::COMMA);
                     expression();
+                    if (map) {
+                        eat(TokenType::ARROW);
+                        expression();
+                    }
                     count++;
                 }
             }
             ignoreNewlines = prev;
             eat(TokenType::RIGHT_BRACE);
-            currentCodeUnit.emit(InstructionType::LIST, count);
+            currentCodeUnit.emit(map ? InstructionType::MAP : InstructionType::LIST, count);
             break;
         }
         default:
@@ -214,7 +621,9 @@ void AuroraContext::primary() {
 }
 
 void AuroraContext::call() {
+    size_t start = currentCodeUnit.instructions.size();
     primary();
+    fields(start);
     if (peek(TokenType::LEFT_PAREN)) {
         eat(TokenType::LEFT_PAREN);
         int count;
@@ -227,11 +636,46 @@ void AuroraContext::call() {
         currentCodeUnit.emit(InstructionType::CALL, count);
     } else if (peek(TokenType::COLON)) {
         eat(TokenType::COLON);
-        primary();
-        currentCodeUnit.emit(InstructionType::IDX);
+        auto &code = currentCodeUnit.instructions;
+        if (code.size() == start + 1 && code[start].type == InstructionType::LOAD) {
+            // the index can't assign the variable, functions can't assign their callers' variables
+            int variable = code[start].operand;
+            code.pop_back();
+            primary();
+            currentCodeUnit.emit(InstructionType::LOAD_IDX, variable);
+        } else {
+            primary();
+            currentCodeUnit.emit(InstructionType::IDX);
+        }
+    }
+    fields(start);
+}
+
+void AuroraContext::fields(size_t start) {
+    auto &code = currentCodeUnit.instructions;
+    while (peek(TokenType::DOT)) {
+        eat(TokenType::DOT);
+        auto field = eat(TokenType::IDENTIFIER).lexeme;
+        if (code.size() == start + 1 && code[start].type == InstructionType::LOAD) {
+            // the field is read where the record is, without copying the record onto the stack
+            auto variable = currentCodeUnit.constants[code.back().operand].asString();
+            code.pop_back();
+            currentCodeUnit.emit(InstructionType::LOAD_FIELD, fieldOperand(variable, field));
+        } else currentCodeUnit.emit(InstructionType::GET_FIELD, fieldOperand("", field));
     }
 }
 
+int AuroraContext::fieldOperand(const std::string &variable, const std::string &field) {
+    int id = AuroraRecord::fieldId(field);
+    std::vector<AuroraObj> operand;
+    if (!variable.empty()) operand.emplace_back(variable);
+    operand.emplace_back(field);
+    operand.emplace_back((double) id);
+    auto offset = fieldOffsets.find(id);
+    operand.emplace_back((double) (offset == fieldOffsets.end() ? -1 : offset->second));
+    return currentCodeUnit.getConstantIndex(AuroraObj(std::move(operand)));
+}
+
 void AuroraContext::unary() {
     if (peek(TokenType::NOT) || peek(TokenType::MINUS)) {
         auto op = eat(peek(TokenType::NOT) ? TokenType::NOT : TokenType::MINUS);
@@ -256,13 +700,51 @@ void AuroraContext::factor() {
 }
 
 void AuroraContext::term() {
+    size_t start = currentCodeUnit.instructions.size();
     factor();
+    size_t firstEnd = currentCodeUnit.instructions.size();
+    std::vector<size_t> adds;
+    bool sum = true;
     while (peek(TokenType::PLUS) || peek(TokenType::MINUS)) {
         auto op = eat(peek(TokenType::PLUS) ? TokenType::PLUS : TokenType::MINUS);
         factor();
+        adds.push_back(currentCodeUnit.instructions.size());
         if (op.type == TokenType::PLUS) currentCodeUnit.emit(InstructionType::ADD);
-        else currentCodeUnit.emit(InstructionType::SUB);
+        else {
+            currentCodeUnit.emit(InstructionType::SUB);
+            sum = false;
+        }
+    }
+    if (!sum) adds.clear();
+    if (firstEnd != currentCodeUnit.instructions.size()) lastSum = {start, firstEnd, std::move(adds)};
+}
+
+bool AuroraContext::appendSum(const std::string &name, size_t start) {
+    // Rebuilding name from a copy of itself would make s = s + piece in a loop quadratic, so the
+    // pieces are left on the stack and added to the variable where it is. Nothing the pieces
+    // evaluate can assign name meanwhile, functions can't assign their callers' variables.
+    auto &code = currentCodeUnit.instructions;
+    if (lastSum.adds.empty() || lastSum.start != start || lastSum.adds.back() != code.size() - 1) return false;
+    if (lastSum.firstEnd != start + 1 || code[start].type != InstructionType::LOAD) return false;
+    auto &loaded = currentCodeUnit.constants[code[start].operand];
+    if (loaded.value.index() != 1 || loaded.asStringUnchecked() != name) return false;
+    // jump targets would shift with the instructions dropped
+    for (size_t i = start; i < code.size(); i++) {
+        auto type = code[i].type;
+        if (type == InstructionType::JMP || type == InstructionType::JMPF || type == InstructionType::JMPT) return false;
+    }
+    std::vector<Instruction> pieces;
+    size_t next = 0;
+    for (size_t i = start + 1; i < code.size(); i++) {
+        if (next < lastSum.adds.size() && lastSum.adds[next] == i) next++;
+        else pieces.push_back(code[i]);
     }
+    code.resize(start);
+    code.insert(code.end(), pieces.begin(), pieces.end());
+    std::vector<AuroraObj> target{AuroraObj(name), AuroraObj((double) lastSum.adds.size())};
+    currentCodeUnit.emit(InstructionType::APPEND, currentCodeUnit.getConstantIndex(AuroraObj(std::move(target))));
+    lastSum.adds.clear();
+    return true;
 }
 
 void AuroraContext::comparison() {
@@ -290,31 +772,73 @@ void AuroraContext::equality() {
     }
 }
 
-void AuroraContext::andExpr() {
+void AuroraContext::patch(const std::vector<int> &jumps) {
+    for (int jump: jumps) currentCodeUnit.instructions[jump].operand = currentCodeUnit.instructions.size();
+}
+
+// Compiles an and/or chain so it short-circuits: every operand but the last is tested with a jump
+// into whenTrue or whenFalse, and the last is left on the stack for the caller to branch on.
+// Returns false if there was no and/or, leaving just the value.
+bool AuroraContext::logical(std::vector<int> &whenTrue, std::vector<int> &whenFalse) {
     equality();
-    while (peek(TokenType::AND)) {
-        eat(TokenType::AND);
+    if (!peek(TokenType::AND) && !peek(TokenType::OR)) return false;
+    std::vector<int> andFalse;
+    while (peek(TokenType::AND) || peek(TokenType::OR)) {
+        if (peek(TokenType::AND)) {
+            eat(TokenType::AND);
+            andFalse.push_back(currentCodeUnit.instructions.size());
+            currentCodeUnit.emit(InstructionType::JMPF);
+        } else {
+            // and binds tighter, so a false and-chain falls through to the next alternative
+            eat(TokenType::OR);
+            whenTrue.push_back(currentCodeUnit.instructions.size());
+            currentCodeUnit.emit(InstructionType::JMPT);
+            patch(andFalse);
+            andFalse.clear();
+        }
         equality();
-        currentCodeUnit.emit(InstructionType::AND);
     }
+    whenFalse.insert(whenFalse.end(), andFalse.begin(), andFalse.end());
+    return true;
 }
 
 void AuroraContext::expression() {
-    andExpr();
-    while (peek(TokenType::OR)) {
-        eat(TokenType::OR);
-        andExpr();
-        currentCodeUnit.emit(InstructionType::OR);
+    std::vector<int> whenTrue, whenFalse;
+    if (!logical(whenTrue, whenFalse)) return;
+    whenFalse.push_back(currentCodeUnit.instructions.size());
+    currentCodeUnit.emit(InstructionType::JMPF);
+    patch(whenTrue);
+    currentCodeUnit.emit(InstructionType::TRUE);
+    int end = currentCodeUnit.instructions.size();
+    currentCodeUnit.emit(InstructionType::JMP);
+    patch(whenFalse);
+    currentCodeUnit.emit(InstructionType::FALSE);
+    patch({end});
+}
+
+void AuroraContext::ifBranches(int blocks, const std::vector<int> &whenTrue, const std::vector<int> &whenFalse) {
+    // the last operand of the condition picks the block, short-circuited operands jump straight to theirs
+    currentCodeUnit.emit(InstructionType::IF, blocks);
+    std::vector<int> ends;
+    for (auto [jumps, block]: {std::make_pair(&whenTrue, blocks), std::make_pair(&whenFalse, blocks + 1)}) {
+        if (jumps->empty()) continue;
+        ends.push_back(currentCodeUnit.instructions.size());
+        currentCodeUnit.emit(InstructionType::JMP);
+        patch(*jumps);
+        currentCodeUnit.emit(InstructionType::BLOCK, block);
     }
+    patch(ends);
 }
 
 void AuroraContext::if_statement() {
-    eat(TokenType::IF);
-    expression();
+    int line = eat(TokenType::IF).line;
+    std::vector<int> whenTrue, whenFalse;
+    logical(whenTrue, whenFalse);
     if (peek(TokenType::NEWLINE)) {
         eat(TokenType::NEWLINE);
         auto prev = currentCodeUnit;
         currentCodeUnit = AuroraCodeUnit();
+        currentCodeUnit.markLine(line);
         while (!peek(TokenType::ELSE) && !peek(TokenType::END)) {
             statement();
         }
@@ -330,13 +854,14 @@ void AuroraContext::if_statement() {
             }
             currentCodeUnit.emit(InstructionType::END);
             elseBlock = currentCodeUnit;
+        } else {
+            elseBlock.markLine(line);
+            elseBlock.emit(InstructionType::END);
         }
         currentCodeUnit = prev;
         eat(TokenType::END);
         eat(TokenType::NEWLINE);
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(elseBlock)));
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(ifBlock)));
-        currentCodeUnit.emit(InstructionType::IF);
+        ifBranches(currentCodeUnit.addConstants({AuroraObj(ifBlock), AuroraObj(elseBlock)}), whenTrue, whenFalse);
     } else {
         auto prev = currentCodeUnit;
         currentCodeUnit = AuroraCodeUnit();
@@ -351,12 +876,11 @@ void AuroraContext::if_statement() {
             currentCodeUnit.emit(InstructionType::END);
             elseBlock = currentCodeUnit;
         } else {
+            elseBlock.markLine(line);
             elseBlock.emit(InstructionType::END);
         }
         currentCodeUnit = prev;
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(elseBlock)));
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(ifBlock)));
-        currentCodeUnit.emit(InstructionType::IF);
+        ifBranches(currentCodeUnit.addConstants({AuroraObj(ifBlock), AuroraObj(elseBlock)}), whenTrue, whenFalse);
     }
 }
 
@@ -365,8 +889,17 @@ void AuroraContext::while_statement() {
     AuroraCodeUnit cond;
     auto prev = currentCodeUnit;
     currentCodeUnit = AuroraCodeUnit();
-    expression();
+    currentCodeUnit.markLine(current.line);
+    std::vector<int> whenTrue, whenFalse;
+    logical(whenTrue, whenFalse);
     currentCodeUnit.emit(InstructionType::RES);
+    for (auto [jumps, result]: {std::make_pair(&whenTrue, InstructionType::TRUE),
+                                std::make_pair(&whenFalse, InstructionType::FALSE)}) {
+        if (jumps->empty()) continue;
+        patch(*jumps);
+        currentCodeUnit.emit(result);
+        currentCodeUnit.emit(InstructionType::RES);
+    }
     cond = currentCodeUnit;
     currentCodeUnit = prev;
     if (peek(TokenType::NEWLINE)) {
@@ -380,18 +913,14 @@ void AuroraContext::while_statement() {
         currentCodeUnit = prev;
         eat(TokenType::END);
         eat(TokenType::NEWLINE);
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(cond)));
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(body)));
-        currentCodeUnit.emit(InstructionType::WLOOP);
+        currentCodeUnit.emit(InstructionType::WLOOP, currentCodeUnit.addConstants({AuroraObj(cond), AuroraObj(body)}));
     } else {
         currentCodeUnit = AuroraCodeUnit();
         statement();
         currentCodeUnit.emit(InstructionType::END);
         auto body = currentCodeUnit;
         currentCodeUnit = prev;
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(cond)));
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(body)));
-        currentCodeUnit.emit(InstructionType::WLOOP);
+        currentCodeUnit.emit(InstructionType::WLOOP, currentCodeUnit.addConstants({AuroraObj(cond), AuroraObj(body)}));
     }
 }
 
@@ -412,15 +941,13 @@ void AuroraContext::for_statement() {
         currentCodeUnit = prev;
         eat(TokenType::END);
         eat(TokenType::NEWLINE);
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(body)));
-        currentCodeUnit.emit(InstructionType::FLOOP, currentCodeUnit.getConstantIndex(AuroraObj(name)));
+        currentCodeUnit.emit(InstructionType::FLOOP, currentCodeUnit.addConstants({AuroraObj(body), AuroraObj(name)}));
     } else {
         statement();
         currentCodeUnit.emit(InstructionType::END);
         auto body = currentCodeUnit;
         currentCodeUnit = prev;
-        currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(body)));
-        currentCodeUnit.emit(InstructionType::FLOOP, currentCodeUnit.getConstantIndex(AuroraObj(name)));
+        currentCodeUnit.emit(InstructionType::FLOOP, currentCodeUnit.addConstants({AuroraObj(body), AuroraObj(name)}));
     }
 }
 
@@ -434,12 +961,15 @@ void AuroraContext::function_statement() {
     if (peek(TokenType::ARROW)) {
         auto prev = currentCodeUnit;
         currentCodeUnit = AuroraCodeUnit();
+        currentCodeUnit.markLine(current.line);
         eat(TokenType::ARROW);
         expression();
+        tailCall();
         currentCodeUnit.emit(InstructionType::RET);
         auto body = currentCodeUnit;
         currentCodeUnit = prev;
-        AuroraFunction fn{params, body};
+        AuroraFunction fn{params, std::make_shared<AuroraCodeUnit>(std::move(body)), name};
+        functionNames[fn.code.get()] = name;
         currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(fn)));
         currentCodeUnit.emit(InstructionType::STORE, currentCodeUnit.getConstantIndex(AuroraObj(name)));
     } else {
@@ -455,12 +985,52 @@ void AuroraContext::function_statement() {
         currentCodeUnit = prev;
         eat(TokenType::END);
         eat(TokenType::NEWLINE);
-        AuroraFunction fn{params, body};
+        AuroraFunction fn{params, std::make_shared<AuroraCodeUnit>(std::move(body)), name};
+        functionNames[fn.code.get()] = name;
         currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraObj(fn)));
         currentCodeUnit.emit(InstructionType::STORE, currentCodeUnit.getConstantIndex(AuroraObj(name)));
     }
 }
 
+void AuroraContext::struct_statement() {
+    eat(TokenType::STRUCT);
+    auto name = eat(TokenType::IDENTIFIER).lexeme;
+    std::vector<std::string> fields;
+    if (!peek(TokenType::NEWLINE)) fields = idList();
+    eat(TokenType::NEWLINE);
+    // declared as it's compiled, so the fields' offsets are known to the code after it
+    auto &type = AuroraRecord::declare(name, fields);
+    for (size_t i = 0; i < type.ids.size(); i++) {
+        auto offset = fieldOffsets.emplace(type.ids[i], (int) i).first;
+        if (offset->second != (int) i) offset->second = -1;
+    }
+    currentCodeUnit.emit(InstructionType::PUSH, currentCodeUnit.getConstantIndex(AuroraRecord::constructor(type)));
+    currentCodeUnit.emit(InstructionType::STORE, currentCodeUnit.getConstantIndex(AuroraObj(name)));
+}
+
+void AuroraContext::tailCall() {
+    // a call whose result is returned straight away can reuse the caller's frame
+    if (!currentCodeUnit.instructions.empty() && currentCodeUnit.instructions.back().type == InstructionType::CALL) {
+        currentCodeUnit.instructions.back().type = InstructionType::TAILCALL;
+    }
+}
+
+// the operation a compound assignment applies
+static InstructionType compoundInstruction(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS_ASSIGN:
+            return InstructionType::ADD;
+        case TokenType::MINUS_ASSIGN:
+            return InstructionType::SUB;
+        case TokenType::STAR_ASSIGN:
+            return InstructionType::MUL;
+        case TokenType::SLASH_ASSIGN:
+            return InstructionType::DIV;
+        default:
+            return InstructionType::MOD;
+    }
+}
+
 TokenType AuroraContext::assignOp() {
     if (isAssignOp(peek())) {
         return eat(peek()).type;
@@ -469,6 +1039,7 @@ TokenType AuroraContext::assignOp() {
 }
 
 void AuroraContext::statement() {
+    currentCodeUnit.markLine(current.line);
     switch (peek()) {
         case TokenType::IF:
             if_statement();
@@ -482,6 +1053,9 @@ void AuroraContext::statement() {
         case TokenType::FN:
             function_statement();
             break;
+        case TokenType::STRUCT:
+            struct_statement();
+            break;
         case TokenType::RETURN:
             eat(TokenType::RETURN);
             if (peek(TokenType::NEWLINE)) {
@@ -489,6 +1063,7 @@ void AuroraContext::statement() {
                 currentCodeUnit.emit(InstructionType::RET);
             } else {
                 expression();
+                tailCall();
                 currentCodeUnit.emit(InstructionType::RET);
                 eat(TokenType::NEWLINE);
             }
@@ -507,119 +1082,77 @@ void AuroraContext::statement() {
             auto name = eat(TokenType::IDENTIFIER).lexeme;
             if (isAssignOp(peek())) {
                 auto op = eat(peek()).type;
+                auto variable = currentCodeUnit.getConstantIndex(AuroraObj(name));
+                // the variable is the left operand, read before the right one is evaluated
+                if (op != TokenType::ASSIGN && op != TokenType::PLUS_ASSIGN)
+                    currentCodeUnit.emit(InstructionType::LOAD, variable);
+                size_t start = currentCodeUnit.instructions.size();
                 expression();
                 switch (op) {
                     case TokenType::ASSIGN:
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                        if (!appendSum(name, start)) currentCodeUnit.emit(InstructionType::STORE, variable);
                         break;
-                    case TokenType::PLUS_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::ADD);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                    case TokenType::PLUS_ASSIGN: {
+                        std::vector<AuroraObj> target{AuroraObj(name), AuroraObj(1.0)};
+                        currentCodeUnit.emit(InstructionType::APPEND,
+                                             currentCodeUnit.getConstantIndex(AuroraObj(std::move(target))));
                         break;
+                    }
                     case TokenType::MINUS_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
                         currentCodeUnit.emit(InstructionType::SUB);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                        currentCodeUnit.emit(InstructionType::STORE, variable);
                         break;
                     case TokenType::STAR_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
                         currentCodeUnit.emit(InstructionType::MUL);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                        currentCodeUnit.emit(InstructionType::STORE, variable);
                         break;
                     case TokenType::SLASH_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
                         currentCodeUnit.emit(InstructionType::DIV);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                        currentCodeUnit.emit(InstructionType::STORE, variable);
                         break;
                     case TokenType::MODULO_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
                         currentCodeUnit.emit(InstructionType::MOD);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
+                        currentCodeUnit.emit(InstructionType::STORE, variable);
                         break;
                 }
+            } else if (peek(TokenType::DOT)) {
+                // name.field = value, or name.a.b = value through the records in between
+                eat(TokenType::DOT);
+                auto field = eat(TokenType::IDENTIFIER).lexeme;
+                bool onStack = false;
+                while (peek(TokenType::DOT)) {
+                    if (onStack) currentCodeUnit.emit(InstructionType::GET_FIELD, fieldOperand("", field));
+                    else currentCodeUnit.emit(InstructionType::LOAD_FIELD, fieldOperand(name, field));
+                    onStack = true;
+                    eat(TokenType::DOT);
+                    field = eat(TokenType::IDENTIFIER).lexeme;
+                }
+                auto op = assignOp();
+                if (op != TokenType::ASSIGN) {
+                    if (onStack) {
+                        currentCodeUnit.emit(InstructionType::DUP);
+                        currentCodeUnit.emit(InstructionType::GET_FIELD, fieldOperand("", field));
+                    } else currentCodeUnit.emit(InstructionType::LOAD_FIELD, fieldOperand(name, field));
+                }
+                expression();
+                if (op != TokenType::ASSIGN) currentCodeUnit.emit(compoundInstruction(op));
+                if (onStack) currentCodeUnit.emit(InstructionType::SET_FIELD, fieldOperand("", field));
+                else currentCodeUnit.emit(InstructionType::STORE_FIELD, fieldOperand(name, field));
             } else if (peek(TokenType::COLON)) {
                 eat(TokenType::COLON);
                 expression();
                 auto op = assignOp();
-                currentCodeUnit.emit(InstructionType::DUP);
-                expression();
-                switch (op) {
-                    case TokenType::ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::POP);
-                        break;
-                    case TokenType::PLUS_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::IDX);
-                        currentCodeUnit.emit(InstructionType::ADD);
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        break;
-                    case TokenType::MINUS_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::IDX);
-                        currentCodeUnit.emit(InstructionType::SUB);
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        break;
-                    case TokenType::STAR_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::IDX);
-                        currentCodeUnit.emit(InstructionType::MUL);
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        break;
-                    case TokenType::SLASH_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::IDX);
-                        currentCodeUnit.emit(InstructionType::DIV);
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        break;
-                    case TokenType::MODULO_ASSIGN:
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::IDX);
-                        currentCodeUnit.emit(InstructionType::MOD);
-                        currentCodeUnit.emit(InstructionType::LOAD,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        currentCodeUnit.emit(InstructionType::SETIDX);
-                        currentCodeUnit.emit(InstructionType::STORE,
-                                             currentCodeUnit.getConstantIndex(AuroraObj(name)));
-                        break;
+                int variable = currentCodeUnit.getConstantIndex(AuroraObj(name));
+                if (op != TokenType::ASSIGN) {
+                    // the element's old value, with the index kept below it for SETIDX
+                    currentCodeUnit.emit(InstructionType::DUP);
+                    currentCodeUnit.emit(InstructionType::LOAD_ENTRY, variable);
                 }
+                expression();
+                if (op != TokenType::ASSIGN) currentCodeUnit.emit(compoundInstruction(op));
+                currentCodeUnit.emit(InstructionType::LOAD, variable);
+                currentCodeUnit.emit(InstructionType::SETIDX);
+                currentCodeUnit.emit(InstructionType::STORE, variable);
             } else {
                 currentCodeUnit.emit(InstructionType::LOAD,
                                      currentCodeUnit.getConstantIndex(AuroraObj(name)));
@@ -629,6 +1162,7 @@ void AuroraContext::statement() {
                 else
                     args = 0;
                 currentCodeUnit.emit(InstructionType::CALL, args);
+                currentCodeUnit.emit(InstructionType::POP);
             }
             eat(TokenType::NEWLINE);
             break;
@@ -642,25 +1176,262 @@ void AuroraContext::statement() {
     }
 }
 
-#define DISPATCH goto *dispatchTable[(int)unit.instructions[++pc].type]
+void AuroraContext::pushFrame(AuroraFrame::Type type, const AuroraCodeUnit *unit) {
+    if (frames.size() >= maxFrames)
+        throw AuroraException("Stack overflow, more than " + std::to_string(maxFrames) + " frames.");
+    try {
+        frames.push_back({type, unit, -1, stack.size(), locals.size()});
+    } catch (const std::bad_alloc &) {
+        overflow();
+    }
+}
 
-AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
-    std::vector<AuroraObj> stack{};
+void AuroraContext::pushScope() {
+    try {
+        locals.emplace_back();
+    } catch (const std::bad_alloc &) {
+        overflow();
+    }
+}
+
+void AuroraContext::overflow() {
+    throw AuroraException("Stack overflow, out of memory at " + std::to_string(frames.size()) + " frames.");
+}
+
+void AuroraContext::bindArguments(const AuroraFunction &fn, int count) {
+    // arguments are the top count values of the stack, the callee is just below them
+    pushScope();
+    size_t first = stack.size() - count;
+    try {
+        for (int i = 0; i < (int) fn.parameters.size() && i < count; i++) {
+            locals.back().emplace(fn.parameters[i], std::move(stack[first + i]));
+        }
+    } catch (const std::bad_alloc &) {
+        overflow();
+    }
+    stack.resize(first);
+}
+
+bool AuroraContext::nextIteration() {
+    auto *frame = &frames.back();
+    const AuroraObj &iter = stack[frame->stackBase - 1];
+    // each iteration starts a fresh scope, but when the body bound nothing else the loop
+    // variable's entry is reused rather than freed and allocated again
+    auto variable = [&]() -> AuroraObj & {
+        auto &scope = locals.back();
+        if (scope.size() == 1) {
+            auto found = scope.find(*frame->name);
+            if (found != scope.end()) return found->second;
+        }
+        scope.clear();
+        return scope[*frame->name];
+    };
+    if (iter.value.index() == 3) {
+        auto &list = iter.asListUnchecked();
+        if (frame->index >= list.size()) return false;
+        variable() = list[frame->index];
+    } else if (iter.value.index() == 1) {
+        auto &str = iter.asStringUnchecked();
+        if (frame->index >= str.size()) return false;
+        variable() = AuroraObj::character(str[frame->index]);
+    } else {
+        // pulling may run script code, which can grow the frame stack and operand stack under us
+        auto source = AuroraIterator::of(iter);
+        AuroraObj element;
+        if (!source->next(element)) return false;
+        frame = &frames.back();
+        variable() = std::move(element);
+    }
+    frame->index++;
+    frame->unit = frame->body;
+    frame->pc = -1;
+    return true;
+}
+
+AuroraObj AuroraContext::execute(const AuroraCodeUnit &main) {
+    executeCalls++;
+    size_t base = frames.size(), stackBase = stack.size(), localsBase = locals.size();
+    pushFrame(AuroraFrame::Type::BLOCK, &main);
+    budgetCountdown -= (int64_t) main.instructions.size();
+    return enter(base, stackBase, localsBase);
+}
+
+AuroraObj AuroraContext::enter(size_t base, size_t stackBase, size_t localsBase) {
+    int depth = base == 0 ? 0 : callDepth;
+    size_t callerBase = base == 0 ? 0 : callBase;
+    size_t traceDepth = tracer ? tracer->depth() : 0;
+    try {
+        AuroraObj result = dispatch(base, stackBase, localsBase);
+#ifdef AURORA_OPCODE_STATS
+        opcodeStats.stop();
+#endif
+        return result;
+    } catch (...) {
+#ifdef AURORA_OPCODE_STATS
+        opcodeStats.stop();
+#endif
+        // snapshot before unwinding, while the stack and locals still hold what filled the heap
+        if (!heapSnapshotPath.empty() && base == 0) {
+            AuroraHeapAccount *account = AuroraAllocations::account;
+            try {
+                throw;
+            } catch (const AuroraHeapLimitException &) {
+                // the snapshot itself is left out of the account, so it can't trip the limit
+                AuroraAllocations::account = nullptr;
+                std::ofstream out(heapSnapshotPath);
+                writeHeapSnapshot(out);
+            } catch (...) {}
+            AuroraAllocations::account = account;
+        }
+        frames.resize(base);
+        stack.resize(stackBase);
+        locals.resize(localsBase);
+        callDepth = depth;
+        callBase = callerBase;
+        if (tracer) tracer->unwind(traceDepth);
+        throw;
+    }
+}
+
+void AuroraContext::writeHeapSnapshot(std::ostream &out) const {
+    std::vector<std::pair<std::string, const AuroraObj *>> roots;
+    for (auto &[name, value]: globals) roots.emplace_back("global " + name, &value);
+    for (size_t i = 0; i < locals.size(); i++) {
+        for (auto &[name, value]: locals[i]) roots.emplace_back("local " + name + " (scope " + std::to_string(i) + ")", &value);
+    }
+    for (size_t i = 0; i < stack.size(); i++) roots.emplace_back("stack[" + std::to_string(i) + "]", &stack[i]);
+    AuroraHeap::writeSnapshot(out, roots);
+}
+
+void AuroraContext::sample(const AuroraCodeUnit *unit, const ThreadedInstruction *ip) {
+    auroraSampleRequested = 0;
+    static const std::string topLevel = "<main>", anonymous = "<anonymous>";
+    if (AuroraAllocations::trackSites) {
+        // keep polling, so every instruction moves the allocation site along
+        auroraSampleRequested = 1;
+        const std::string *function = &topLevel;
+        for (size_t i = frames.size(); i-- > 0;) {
+            if (frames[i].type != AuroraFrame::Type::CALL) continue;
+            auto it = functionNames.find(frames[i].unit);
+            function = it == functionNames.end() ? &anonymous : &it->second;
+            break;
+        }
+        AuroraHeap::setSite(function, unit->lineAt(ip - unit->threaded.load()));
+    }
+    bool tick = profiler && profiler->consumeTick(), overflowed = perfCounters && perfCounters->pending();
+    if (!tick && !overflowed) return;
+    std::vector<std::pair<const std::string *, int>> functions;
+    const std::string *function = &topLevel;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (frames[i].type != AuroraFrame::Type::CALL) continue;
+        // the caller is at the CALL in the frame below
+        if (i > 0) functions.emplace_back(function, frames[i - 1].unit->lineAt(frames[i - 1].pc));
+        auto it = functionNames.find(frames[i].unit);
+        function = it == functionNames.end() ? &anonymous : &it->second;
+    }
+    functions.emplace_back(function, unit->lineAt(ip - unit->threaded.load()));
+    if (tick) profiler->record(functions);
+    // the signal most likely arrived while the previous instruction ran
+    if (overflowed) perfCounters->attribute(*function, (ip > unit->threaded.load() ? ip - 1 : ip)->type);
+}
+
+#if defined(AURORA_OPCODE_STATS)
+#define RECORD_OPCODE opcodeStats.record((ip + 1)->type, stack);
+#elif defined(AURORA_COUNT_INSTRUCTIONS)
+#define RECORD_OPCODE instructionsExecuted++;
+#else
+#define RECORD_OPCODE
+#endif
+#define POLL_SAMPLE if (__builtin_expect(auroraSampleRequested, 0)) sample(unit, ip);
+#ifdef AURORA_TABLE_DISPATCH
+#define DISPATCH RECORD_OPCODE ++ip; POLL_SAMPLE goto *dispatchTable[(int)ip->type]
+#else
+#define DISPATCH RECORD_OPCODE ++ip; POLL_SAMPLE goto *ip->handler
+#endif
+#define SAVE_FRAME frames.back().pc = ip - unit->threaded.load(std::memory_order_relaxed)
+#define LOAD_FRAME \
+    unit = frames.back().unit; \
+    ip = unit->threaded.load(std::memory_order_acquire); \
+    if (__builtin_expect(!ip, 0)) ip = thread(*unit); \
+    ip += frames.back().pc
+// each unit entered is charged in full; jumps only go forward, so that bounds what it can run
+#define CHARGE budgetCountdown -= (int64_t) unit->instructions.size()
+// back-edges and calls are the only way a script keeps running, so the budget is checked there
+#define CHECK_BUDGET \
+    CHARGE; \
+    if (__builtin_expect(budgetCountdown < 0, 0) && budgetSpent(base)) { \
+        suspendedAt.emplace(stackBase, localsBase); \
+        return AuroraObj(); \
+    }
+
+AuroraObj AuroraContext::dispatch(size_t base, size_t stackBase, size_t localsBase) {
     static void *dispatchTable[] = {
             &&PUSH, &&PUSHI, &&TRUE, &&FALSE, &&POP, &&ADD,
             &&SUB, &&MUL, &&DIV, &&MOD, &&NEG, &&NOT,
-            &&AND, &&OR, &&EQ, &&NEQ, &&LT, &&GT,
+            &&EQ, &&NEQ, &&LT, &&GT,
             &&LTE, &&GTE, &&CALL, &&RET, &&RES, &&LOAD,
             &&STORE, &&IF, &&FLOOP, &&WLOOP, &&IDX, &&SETIDX,
-            &&BREAK, &&CONTINUE, &&DUP, &&LIST, &&END
+            &&BREAK, &&CONTINUE, &&DUP, &&LIST, &&MAP, &&END, &&TAILCALL,
+            &&JMP, &&JMPF, &&JMPT, &&BLOCK, &&APPEND, &&LOAD_IDX, &&LOAD_ENTRY,
+            &&GET_FIELD, &&SET_FIELD, &&LOAD_FIELD, &&STORE_FIELD,
+            &&ADD_NUM, &&ADD_STR, &&SUB_NUM, &&MUL_NUM, &&DIV_NUM, &&MOD_NUM,
+            &&NEG_NUM, &&NOT_BOOL, &&EQ_NUM, &&NEQ_NUM,
+            &&LT_NUM, &&GT_NUM, &&LTE_NUM, &&GTE_NUM, &&IDX_LIST, &&IDX_STR,
+            &&CALL_FN, &&CALL_NATIVE
     };
-    int pc = -1;
+    // translates a unit on its first execution: handler addresses and operands are decoded once. If
+    // another thread translated it meanwhile, its code is used and this copy thrown away.
+    auto thread = [](const AuroraCodeUnit &unit) -> const ThreadedInstruction * {
+        auto code = new ThreadedInstruction[unit.instructions.size()];
+        for (size_t i = 0; i < unit.instructions.size(); i++) {
+            auto &instruction = unit.instructions[i];
+            ThreadedInstruction threaded{dispatchTable[(int) instruction.type], instruction.type, {}};
+            switch (instruction.type) {
+                case InstructionType::PUSH:
+                case InstructionType::LOAD:
+                case InstructionType::STORE:
+                case InstructionType::BLOCK:
+                case InstructionType::APPEND:
+                case InstructionType::LOAD_IDX:
+                case InstructionType::LOAD_ENTRY:
+                case InstructionType::GET_FIELD:
+                case InstructionType::SET_FIELD:
+                case InstructionType::LOAD_FIELD:
+                case InstructionType::STORE_FIELD:
+                case InstructionType::IF:
+                case InstructionType::WLOOP:
+                case InstructionType::FLOOP:
+                    threaded.constant = &unit.constants[instruction.operand];
+                    break;
+                case InstructionType::PUSHI:
+                    threaded.number = instruction.operand;
+                    break;
+                default:
+                    threaded.operand = instruction.operand;
+                    break;
+            }
+            code[i] = threaded;
+        }
+        for (size_t i = 0; i < unit.instructions.size(); i++) {
+            auto type = unit.instructions[i].type;
+            if (type == InstructionType::JMP || type == InstructionType::JMPF || type == InstructionType::JMPT) {
+                code[i].target = code + unit.instructions[i].operand - 1;
+            }
+        }
+        const ThreadedInstruction *published = nullptr;
+        if (unit.threaded.compare_exchange_strong(published, code, std::memory_order_acq_rel)) return code;
+        delete[] code;
+        return published;
+    };
+    const AuroraCodeUnit *unit;
+    const ThreadedInstruction *ip;
+    LOAD_FRAME;
     DISPATCH;
     PUSH:
-    stack.emplace_back(unit.constants[unit.instructions[pc].operand]);
+    stack.emplace_back(*ip->constant);
     DISPATCH;
     PUSHI:
-    stack.emplace_back((double) unit.instructions[pc].operand);
+    stack.emplace_back(ip->number);
     DISPATCH;
     TRUE:
     stack.emplace_back(true);
@@ -673,14 +1444,15 @@ AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
     DISPATCH;
     ADD:
     {
-        AuroraObj b = stack.back();
+        AuroraObj b = std::move(stack.back());
         stack.pop_back();
-        AuroraObj a = stack.back();
-        stack.pop_back();
-        if (a.value.index() == 0 && b.value.index() == 0) stack.emplace_back(a.asDouble() + b.asDouble());
-        else if (a.value.index() == 1 && b.value.index() == 1)
-            stack.emplace_back(a.asString() + b.asString());
-        else throw AuroraException("Invalid operands for +.");
+        AuroraObj &a = stack.back();
+        if (a.value.index() == 0 && b.value.index() == 0) a.asDoubleUnchecked() += b.asDoubleUnchecked();
+        else if (a.value.index() == 1 && b.value.index() == 1) {
+            // in place, as in ADD_STR
+            if (__builtin_expect(AuroraAllocations::counting(), 0)) a = AuroraObj(a.asStringUnchecked() + b.asStringUnchecked());
+            else std::get<std::string>(a.value) += b.asStringUnchecked();
+        } else throw AuroraException("Invalid operands for +.");
     }
     DISPATCH;
     SUB:
@@ -739,28 +1511,6 @@ AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
         else throw AuroraException("Invalid operand for !.");
     }
     DISPATCH;
-    AND:
-    {
-        AuroraObj b = stack.back();
-        stack.pop_back();
-        AuroraObj a = stack.back();
-        stack.pop_back();
-        if (a.value.index() == 2 && b.value.index() == 2)
-            stack.emplace_back(a.asBool() && b.asBool());
-        else throw AuroraException("Invalid operands for &&.");
-    }
-    DISPATCH;
-    OR:
-    {
-        AuroraObj b = stack.back();
-        stack.pop_back();
-        AuroraObj a = stack.back();
-        stack.pop_back();
-        if (a.value.index() == 2 && b.value.index() == 2)
-            stack.emplace_back(a.asBool() || b.asBool());
-        else throw AuroraException("Invalid operands for ||.");
-    }
-    DISPATCH;
     EQ:
     {
         AuroraObj b = stack.back();
@@ -829,123 +1579,142 @@ AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
     DISPATCH;
     IF:
     {
-        AuroraCodeUnit then = stack.back().asCodeUnit();
-        stack.pop_back();
-        AuroraCodeUnit else_ = stack.back().asCodeUnit();
+        AuroraObj cond = std::move(stack.back());
         stack.pop_back();
-        AuroraObj cond = stack.back();
+        if (cond.value.index() != 2) throw AuroraException("Invalid operand for if.");
+        // the else block is always the constant right after the then block
+        auto &block = ip->constant[cond.asBool() ? 0 : 1];
+        SAVE_FRAME;
+        pushFrame(AuroraFrame::Type::BLOCK, &std::get<AuroraCodeUnit>(block.value));
+        pushScope();
+        LOAD_FRAME;
+        CHARGE;
+    }
+    DISPATCH;
+    BLOCK:
+    SAVE_FRAME;
+    pushFrame(AuroraFrame::Type::BLOCK, &std::get<AuroraCodeUnit>(ip->constant->value));
+    pushScope();
+    LOAD_FRAME;
+    CHARGE;
+    DISPATCH;
+    JMP:
+    ip = ip->target;
+    DISPATCH;
+    JMPF:
+    JMPT:
+    {
+        if (stack.back().value.index() != 2) throw AuroraException("Invalid operands for and/or.");
+        bool cond = stack.back().asBoolUnchecked();
         stack.pop_back();
-        if (cond.value.index() == 2) {
-            locals.emplace_back();
-            if (cond.asBool()) execute(then);
-            else execute(else_);
-            locals.pop_back();
-        } else throw AuroraException("Invalid operand for if.");
+        if (cond == (ip->type == InstructionType::JMPT)) ip = ip->target;
     }
     DISPATCH;
     WLOOP:
     {
-        AuroraCodeUnit body = stack.back().asCodeUnit();
-        stack.pop_back();
-        AuroraCodeUnit cond = stack.back().asCodeUnit();
-        stack.pop_back();
-        locals.emplace_back();
-        while (execute(cond).asBool()) {
-            try {
-                execute(body);
-                locals.back().clear();
-            } catch (InternalAuroraException &e) {
-                if (e.type == InternalAuroraException::Type::BREAK) {
-                    break;
-                } else if (e.type == InternalAuroraException::Type::CONTINUE) {
-                    continue;
-                }
-            }
-        }
-        locals.pop_back();
+        SAVE_FRAME;
+        auto cond = &std::get<AuroraCodeUnit>(ip->constant[0].value);
+        pushFrame(AuroraFrame::Type::WHILE, cond);
+        frames.back().cond = cond;
+        frames.back().body = &std::get<AuroraCodeUnit>(ip->constant[1].value);
+        pushScope();
+        LOAD_FRAME;
+        CHARGE;
     }
     DISPATCH;
     FLOOP:
     {
-        AuroraCodeUnit body = stack.back().asCodeUnit();
-        stack.pop_back();
-        AuroraObj iter = stack.back();
-        stack.pop_back();
-        auto name = unit.constants[unit.instructions[pc].operand].asString();
-        if (iter.value.index() == 3) {
-            locals.emplace_back();
-            for (auto &i: iter.asVector()) {
-                try {
-                    locals.back().clear();
-                    locals.back().emplace(name, i);
-                    execute(body);
-                } catch (InternalAuroraException &e) {
-                    if (e.type == InternalAuroraException::Type::BREAK) {
-                        break;
-                    } else if (e.type == InternalAuroraException::Type::CONTINUE) {
-                        continue;
-                    }
-                }
-            }
-        } else if (iter.value.index() == 1) {
-            locals.emplace_back();
-            for (auto &i: iter.asString()) {
-                try {
-                    locals.back().clear();
-                    locals.back().emplace(name, AuroraObj(std::string(1, i)));
-                    execute(body);
-                } catch (InternalAuroraException &e) {
-                    if (e.type == InternalAuroraException::Type::BREAK) {
-                        break;
-                    } else if (e.type == InternalAuroraException::Type::CONTINUE) {
-                        continue;
-                    }
-                }
-            }
-        } else throw AuroraException("Invalid operand for for.");
-        locals.pop_back();
+        // the iterable stays on the stack, just below the loop frame, until the loop ends; a map's
+        // keys are taken up front, so the body may change the map
+        if (auto map = AuroraMap::of(stack.back())) stack.back() = AuroraObj(map->keys());
+        if (stack.back().value.index() != 3 && stack.back().value.index() != 1 && !AuroraIterator::of(stack.back()))
+            throw AuroraException("Invalid operand for for.");
+        SAVE_FRAME;
+        auto body = &std::get<AuroraCodeUnit>(ip->constant[0].value);
+        auto name = &std::get<std::string>(ip->constant[1].value);
+        pushFrame(AuroraFrame::Type::FOR, body);
+        frames.back().body = body;
+        frames.back().name = name;
+        pushScope();
+        if (!nextIteration()) goto loop_exit;
+        LOAD_FRAME;
+        CHARGE;
     }
     DISPATCH;
     CALL:
     {
-        std::vector<AuroraObj> args{};
-        for (int i = 0; i < unit.instructions[pc].operand; i++) {
-            args.insert(args.begin(), stack.back());
-            stack.pop_back();
+        auto &fnObj = stack[stack.size() - ip->operand - 1];
+        if (fnObj.value.index() == 4) goto CALL_FN;
+        else if (fnObj.value.index() == 7) goto CALL_NATIVE;
+        else if (fnObj.value.index() == 10) goto CALL_ITERATOR;
+        else throw AuroraException("Invalid operand for call.");
+    }
+    TAILCALL:
+    {
+        // return f(x): reuse the frame of the enclosing call rather than pushing a new one
+        int count = ip->operand;
+        auto &fnObj = stack[stack.size() - count - 1];
+        if (fnObj.value.index() == 7) goto CALL_NATIVE;
+        else if (fnObj.value.index() == 10) goto CALL_ITERATOR;
+        else if (fnObj.value.index() != 4) throw AuroraException("Invalid operand for call.");
+        size_t caller = frames.size() - 1;
+        while (caller > base && frames[caller].type != AuroraFrame::Type::CALL) caller--;
+        if (frames[caller].type != AuroraFrame::Type::CALL) goto CALL_FN;
+        size_t from = stack.size() - count - 1, to = frames[caller].stackBase - 1;
+        for (int i = 0; i <= count; i++) stack[to + i] = std::move(stack[from + i]);
+        stack.resize(to + count + 1);
+        frames.resize(caller + 1);
+        locals.resize(frames.back().localsBase);
+        auto &fn = stack[to].asFunctionUnchecked();
+        if (tracer) {
+            tracer->end();
+            tracer->begin(fn.name, "function");
         }
-        auto fnObj = stack.back();
-        stack.pop_back();
-        if (fnObj.value.index() == 4) {
-            auto fn = fnObj.asFunction();
-            auto tmpLocals = locals;
-            locals = {};
-            locals.emplace_back();
-            for (int i = 0; i < fn.parameters.size(); i++) {
-                locals.back().emplace(fn.parameters[i], args[i]);
-            }
-            AuroraObj retVal;
-            try {
-                execute(fn.code);
-            } catch (AuroraReturnException &e) {
-                retVal = e.value;
-            }
-            stack.emplace_back(retVal);
-            locals = tmpLocals;
-        } else if (fnObj.value.index() == 7) {
-            auto fn = fnObj.asNativeFunction();
-            stack.emplace_back(fn(args));
-        } else throw AuroraException("Invalid operand for call.");
+        frames.back().unit = fn.code.get();
+        frames.back().pc = -1;
+        bindArguments(fn, count);
+        LOAD_FRAME;
+        CHECK_BUDGET;
     }
     DISPATCH;
     RET:
-    throw AuroraReturnException(stack.back());
+    {
+        AuroraObj result = std::move(stack.back());
+        // unwind the blocks and loops of the returning function
+        while (frames.size() > base && frames.back().type != AuroraFrame::Type::CALL) frames.pop_back();
+        if (frames.size() == base) {
+            stack.resize(stackBase);
+            locals.resize(localsBase);
+            return result;
+        }
+        auto &frame = frames.back();
+        if (tracer) tracer->end();
+        locals.resize(frame.localsBase);
+        callBase = frame.callerBase;
+        callDepth--;
+        stack.resize(frame.stackBase - 1);
+        stack.push_back(std::move(result));
+        frames.pop_back();
+        LOAD_FRAME;
+    }
+    DISPATCH;
     RES:
-    return stack.back();
+    {
+        // end of a while condition
+        bool loop = stack.back().asBool();
+        stack.pop_back();
+        if (!loop) goto loop_exit;
+        frames.back().unit = frames.back().body;
+        frames.back().pc = -1;
+        LOAD_FRAME;
+        CHARGE;
+    }
+    DISPATCH;
     LOAD:
-    stack.emplace_back(lookupVariable(unit.constants[unit.instructions[pc].operand].asString()));
+    stack.emplace_back(lookupVariable(std::get<std::string>(ip->constant->value)));
     DISPATCH;
     STORE:
-    setVariable(unit.constants[unit.instructions[pc].operand].asString(), stack.back());
+    setVariable(std::get<std::string>(ip->constant->value), std::move(stack.back()));
     stack.pop_back();
     DISPATCH;
     IDX:
@@ -954,10 +1723,13 @@ AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
         stack.pop_back();
         AuroraObj b = stack.back();
         stack.pop_back();
-        if (b.value.index() == 3 && a.value.index() == 0) stack.emplace_back(b.asVector()[a.asDouble()]);
+        if (b.value.index() == 3 && a.value.index() == 0) stack.push_back(b.asListUnchecked()[a.asDoubleUnchecked()]);
         else if (b.value.index() == 1 && a.value.index() == 0)
-            stack.emplace_back(std::string(1, b.asString()[a.asDouble()]));
-        else throw AuroraException("Invalid operands for indexing.");
+            stack.emplace_back(AuroraObj::character(b.asString()[a.asDouble()]));
+        else if (auto map = AuroraMap::of(b)) {
+            auto found = map->get(a);
+            stack.push_back(found ? *found : AuroraObj());
+        } else throw AuroraException("Invalid operands for indexing.");
     }
     DISPATCH;
     SETIDX:
@@ -969,34 +1741,290 @@ AuroraObj AuroraContext::execute(AuroraCodeUnit unit) {
         AuroraObj b = stack.back();
         stack.pop_back();
         if (a.value.index() == 3 && b.value.index() == 0) {
-            auto newVec = a.asVector();
-            newVec.at(b.asDouble()) = c;
-            stack.emplace_back(newVec);
+            // the list on the stack is a copy already; heap accounting has to see it change buffers
+            if (__builtin_expect(AuroraAllocations::counting(), 0)) {
+                AuroraList list = a.asListUnchecked();
+                list.set(b.asDoubleUnchecked(), std::move(c));
+                stack.emplace_back(std::move(list));
+            } else {
+                std::get<AuroraList>(a.value).set(b.asDoubleUnchecked(), std::move(c));
+                stack.push_back(std::move(a));
+            }
         } else if (a.value.index() == 1 && b.value.index() == 0) {
             auto newStr = a.asString();
             newStr.at(b.asDouble()) = c.asString()[0];
             stack.emplace_back(newStr);
+        } else if (auto map = AuroraMap::of(a)) {
+            // maps are shared, so the variable gets back the map it held
+            map->set(b, std::move(c));
+            stack.push_back(std::move(a));
         } else throw AuroraException("Invalid operands for indexing.");
     }
     DISPATCH;
     BREAK:
-    throw InternalAuroraException(InternalAuroraException::Type::BREAK);
     CONTINUE:
-    throw InternalAuroraException(InternalAuroraException::Type::CONTINUE);
+    {
+        bool isBreak = ip->type == InstructionType::BREAK;
+        while (frames.size() > base + 1 && frames.back().type == AuroraFrame::Type::BLOCK) frames.pop_back();
+        if (frames.back().type != AuroraFrame::Type::WHILE && frames.back().type != AuroraFrame::Type::FOR)
+            throw AuroraException(std::string("Cannot ") + (isBreak ? "break" : "continue") + " outside of a loop.");
+        locals.resize(frames.back().localsBase + 1);
+        if (isBreak) goto loop_exit;
+    }
+    loop_next:
+    {
+        // the body of the loop on top of the frame stack has finished
+        auto &frame = frames.back();
+        stack.resize(frame.stackBase);
+        // nextIteration resets a for loop's scope itself
+        if (frame.type == AuroraFrame::Type::WHILE) {
+            locals.back().clear();
+            frame.unit = frame.cond;
+            frame.pc = -1;
+            LOAD_FRAME;
+            CHECK_BUDGET;
+            DISPATCH;
+        }
+        if (nextIteration()) {
+            LOAD_FRAME;
+            CHECK_BUDGET;
+            DISPATCH;
+        }
+    }
+    loop_exit:
+    {
+        auto &frame = frames.back();
+        locals.resize(frame.localsBase);
+        stack.resize(frame.type == AuroraFrame::Type::FOR ? frame.stackBase - 1 : frame.stackBase);
+        frames.pop_back();
+        LOAD_FRAME;
+    }
+    DISPATCH;
     DUP:
     stack.emplace_back(stack.back());
     DISPATCH;
     LIST:
     {
-        std::vector<AuroraObj> list;
-        for (int i = 0; i < unit.instructions[pc].operand; i++) {
-            list.emplace_back(stack.back());
-            stack.pop_back();
+        size_t first = stack.size() - ip->operand;
+        bool numbers = true;
+        for (size_t i = first; i < stack.size() && numbers; i++) numbers = stack[i].value.index() == 0;
+        if (numbers) {
+            std::vector<double> list;
+            list.reserve(ip->operand);
+            for (size_t i = first; i < stack.size(); i++) list.push_back(stack[i].asDoubleUnchecked());
+            stack.resize(first);
+            stack.emplace_back(AuroraList(std::move(list)));
+        } else {
+            std::vector<AuroraObj> list(std::make_move_iterator(stack.begin() + first),
+                                        std::make_move_iterator(stack.end()));
+            stack.resize(first);
+            stack.emplace_back(std::move(list));
         }
-        std::reverse(list.begin(), list.end());
-        stack.emplace_back(list);
+    }
+    DISPATCH;
+    MAP:
+    {
+        AuroraObj map = AuroraMap::make();
+        auto &entries = *AuroraMap::of(map);
+        size_t first = stack.size() - 2 * ip->operand;
+        for (size_t i = first; i < stack.size(); i += 2) entries.set(stack[i], std::move(stack[i + 1]));
+        stack.resize(first);
+        stack.push_back(std::move(map));
     }
     DISPATCH;
     END:
-    return AuroraObj();
+    switch (frames.back().type) {
+        case AuroraFrame::Type::BLOCK:
+            locals.resize(frames.back().localsBase);
+            stack.resize(frames.back().stackBase);
+            frames.pop_back();
+            if (frames.size() == base) return AuroraObj();
+            LOAD_FRAME;
+            DISPATCH;
+        case AuroraFrame::Type::WHILE:
+        case AuroraFrame::Type::FOR:
+            goto loop_next;
+        case AuroraFrame::Type::CALL:
+            stack.emplace_back();
+            goto RET;
+    }
+    // typed variants: operand types were proven by AuroraTypeInference, so nothing is checked here
+#define NUMERIC_OP(result) \
+    { \
+        double b = stack.back().asDoubleUnchecked(); \
+        stack.pop_back(); \
+        double a = stack.back().asDoubleUnchecked(); \
+        stack.back() = AuroraObj(result); \
+    } \
+    DISPATCH;
+    APPEND:
+    {
+        auto &target = std::get<AuroraList>(ip->constant->value).values();
+        AuroraObj &variable = assignable(std::get<std::string>(target[0].value));
+        size_t count = std::get<double>(target[1].value);
+        for (size_t i = stack.size() - count; i < stack.size(); i++) {
+            auto &piece = stack[i];
+            if (variable.value.index() == 0 && piece.value.index() == 0)
+                variable.asDoubleUnchecked() += piece.asDoubleUnchecked();
+            else if (variable.value.index() == 1 && piece.value.index() == 1) {
+                // as in ADD_STR, the heap accounting has to see the buffer change
+                if (__builtin_expect(AuroraAllocations::counting(), 0))
+                    variable = AuroraObj(variable.asStringUnchecked() + piece.asStringUnchecked());
+                else std::get<std::string>(variable.value) += piece.asStringUnchecked();
+            } else throw AuroraException("Invalid operands for +.");
+        }
+        stack.resize(stack.size() - count);
+    }
+    DISPATCH;
+    ADD_NUM:
+    NUMERIC_OP(a + b)
+    ADD_STR:
+    {
+        AuroraObj b = std::move(stack.back());
+        stack.pop_back();
+        // appending in place would grow the buffer behind the heap accounting's back
+        if (__builtin_expect(AuroraAllocations::counting(), 0)) {
+            stack.back() = AuroraObj(stack.back().asStringUnchecked() + b.asStringUnchecked());
+        } else std::get<std::string>(stack.back().value) += b.asStringUnchecked();
+    }
+    DISPATCH;
+    SUB_NUM:
+    NUMERIC_OP(a - b)
+    MUL_NUM:
+    NUMERIC_OP(a * b)
+    DIV_NUM:
+    NUMERIC_OP(a / b)
+    MOD_NUM:
+    NUMERIC_OP(dmod(a, b))
+    NEG_NUM:
+    stack.back().asDoubleUnchecked() = -stack.back().asDoubleUnchecked();
+    DISPATCH;
+    NOT_BOOL:
+    stack.back() = AuroraObj(!stack.back().asBoolUnchecked());
+    DISPATCH;
+    EQ_NUM:
+    NUMERIC_OP(a == b)
+    NEQ_NUM:
+    NUMERIC_OP(a != b)
+    LT_NUM:
+    NUMERIC_OP(a < b)
+    GT_NUM:
+    NUMERIC_OP(a > b)
+    LTE_NUM:
+    NUMERIC_OP(a <= b)
+    GTE_NUM:
+    NUMERIC_OP(a >= b)
+#undef NUMERIC_OP
+    LOAD_IDX:
+    LOAD_ENTRY:
+    {
+        auto &b = lookupVariable(std::get<std::string>(ip->constant->value));
+        AuroraObj &a = stack.back();
+        if (b.value.index() == 3 && a.value.index() == 0) a = b.asListUnchecked()[a.asDoubleUnchecked()];
+        else if (b.value.index() == 1 && a.value.index() == 0)
+            a = AuroraObj::character(b.asStringUnchecked()[a.asDoubleUnchecked()]);
+        else if (auto map = AuroraMap::of(b)) {
+            auto found = map->get(a);
+            if (found) a = *found;
+            else a = ip->type == InstructionType::LOAD_ENTRY ? AuroraObj(0.0) : AuroraObj();
+        } else throw AuroraException("Invalid operands for indexing.");
+    }
+    DISPATCH;
+    GET_FIELD:
+    {
+        auto &operand = std::get<AuroraList>(ip->constant->value).values();
+        auto &record = AuroraRecord::from(stack.back());
+        AuroraObj value = record.field(std::get<double>(operand[1].value), std::get<double>(operand[2].value));
+        stack.back() = std::move(value);
+    }
+    DISPATCH;
+    SET_FIELD:
+    {
+        auto &operand = std::get<AuroraList>(ip->constant->value).values();
+        auto &record = AuroraRecord::from(stack[stack.size() - 2]);
+        record.field(std::get<double>(operand[1].value), std::get<double>(operand[2].value)) = std::move(stack.back());
+        stack.resize(stack.size() - 2);
+    }
+    DISPATCH;
+    LOAD_FIELD:
+    {
+        auto &operand = std::get<AuroraList>(ip->constant->value).values();
+        auto &record = AuroraRecord::from(lookupVariable(std::get<std::string>(operand[0].value)));
+        stack.push_back(record.field(std::get<double>(operand[2].value), std::get<double>(operand[3].value)));
+    }
+    DISPATCH;
+    STORE_FIELD:
+    {
+        // records are shared, so the variable needn't be assigned again
+        auto &operand = std::get<AuroraList>(ip->constant->value).values();
+        auto &record = AuroraRecord::from(lookupVariable(std::get<std::string>(operand[0].value)));
+        record.field(std::get<double>(operand[2].value), std::get<double>(operand[3].value)) = std::move(stack.back());
+        stack.pop_back();
+    }
+    DISPATCH;
+    IDX_LIST:
+    {
+        int i = stack.back().asDoubleUnchecked();
+        stack.pop_back();
+        AuroraObj element = stack.back().asListUnchecked()[i];
+        stack.back() = std::move(element);
+    }
+    DISPATCH;
+    IDX_STR:
+    {
+        int i = stack.back().asDoubleUnchecked();
+        stack.pop_back();
+        char c = stack.back().asStringUnchecked()[i];
+        stack.back() = AuroraObj::character(c);
+    }
+    DISPATCH;
+    CALL_FN:
+    {
+        int count = ip->operand;
+        auto &fn = stack[stack.size() - count - 1].asFunctionUnchecked();
+        if (tracer) tracer->begin(fn.name, "function");
+        SAVE_FRAME;
+        pushFrame(AuroraFrame::Type::CALL, fn.code.get());
+        frames.back().stackBase = stack.size() - count;
+        frames.back().callerBase = callBase;
+        callBase = locals.size();
+        callDepth++;
+        bindArguments(fn, count);
+        LOAD_FRAME;
+        CHECK_BUDGET;
+    }
+    DISPATCH;
+    CALL_NATIVE:
+    {
+        nativeCalls++;
+        int count = ip->operand;
+        std::vector<AuroraObj> args(std::make_move_iterator(stack.end() - count),
+                                    std::make_move_iterator(stack.end()));
+        stack.resize(stack.size() - count);
+        auto &native = stack.back().asNativeFunctionUnchecked();
+        if (tracer) tracer->begin(tracer->nativeName(native), "native");
+        AuroraObj result = native(args);
+        if (tracer) tracer->end();
+        stack.back() = std::move(result);
+        // natives that block or yield hand the thread back to schedule, which resumes after the call
+        if (__builtin_expect(pause != Pause::NONE, 0)) {
+            if (base != 0) {
+                if (pause == Pause::EMIT) throw AuroraException("Generators can't emit under a native call.");
+                throw AuroraException("Tasks can't block or yield under a native call.");
+            }
+            SAVE_FRAME;
+            suspendedAt.emplace(stackBase, localsBase);
+            return AuroraObj();
+        }
+    }
+    DISPATCH;
+    CALL_ITERATOR:
+    {
+        // reached from CALL and TAILCALL only, calling an iterator pulls its next element
+        nativeCalls++;
+        int count = ip->operand;
+        AuroraObj result = AuroraIterator::call(stack[stack.size() - count - 1], count);
+        stack.back() = std::move(result);
+    }
+    DISPATCH;
 }
\ No newline at end of file
@@ -8,13 +8,73 @@
 #include "lexer.h"
 #include "aurora_obj.h"
 #include <stack>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
 #include "instruction.h"
 #include "aurora_exception.h"
+#include "profiler.h"
+#include "stats.h"
+#include "perf_counters.h"
+#include "tracer.h"
+#include "heap.h"
+#include "channel.h"
+#include "iterator.h"
+#include "output.h"
+
+// an activation on the VM's own frame stack, so script recursion never recurses natively
+struct AuroraFrame {
+    enum class Type {
+        BLOCK, CALL, WHILE, FOR
+    };
+    Type type = Type::BLOCK;
+    const AuroraCodeUnit *unit = nullptr;
+    int pc = -1;
+    size_t stackBase = 0; // operand stack height on entry; a call's callee and a for's iterable sit just below
+    size_t localsBase = 0; // scopes from here up belong to this frame
+    size_t callerBase = 0; // calls: the caller's callBase
+    const AuroraCodeUnit *cond = nullptr, *body = nullptr; // loops
+    const std::string *name = nullptr; // for: the loop variable
+    size_t index = 0; // for: the next element
+};
+
+// a green thread's VM state, kept here while another task of the context runs
+struct AuroraTask {
+    std::vector<std::unordered_map<std::string, AuroraObj>> locals;
+    std::vector<AuroraObj> stack;
+    std::vector<AuroraFrame> frames;
+    size_t callBase = 0;
+    int callDepth = 0;
+    std::optional<std::pair<size_t, size_t>> suspendedAt;
+    AuroraCodeUnit entry; // calls the spawned function and returns its result, the task's bottom frame
+    bool finished = false;
+    AuroraObj result;
+    std::vector<size_t> awaiting; // tasks blocked in await on this one
+};
+
+class AuroraContext;
+
+// a generator's frames, which run inside the context that made it each time an element is pulled
+struct AuroraGenerator : AuroraIterator {
+    AuroraContext *context = nullptr;
+    AuroraTask state;
+    AuroraObj emitted;
+    bool running = false, finished = false;
+
+    bool next(AuroraObj &out) override;
+};
 
 class AuroraContext {
+    friend struct AuroraGenerator;
+
     Lexer scanner;
     std::unordered_map<std::string, AuroraObj>& globals;
     std::vector<std::unordered_map<std::string, AuroraObj>> locals;
+    std::vector<AuroraObj> stack;
+    std::vector<AuroraFrame> frames;
+    // first scope of the innermost call, functions can't see their callers' locals
+    size_t callBase = 0;
 
     [[nodiscard]] TokenType peek() const { return current.type; }
 
@@ -24,42 +84,249 @@ class AuroraContext {
 
     Token eat(TokenType type);
 
-    AuroraObj lookupVariable(const std::string &name) {
+    Token nextToken();
+
+    uint64_t tokenCount = 1; // the constructor reads the first
+    uint64_t executeCalls = 0, nativeCalls = 0;
+
+    const AuroraObj &lookupVariable(const std::string &name) {
         // decend downards through locals
         // if not found, return global
-        if(!locals.empty()) {
-            for (int i = locals.size() - 1; i >= 0; i--) {
-                if(locals[i].find(name) != locals[i].end()) {
-                    return locals[i][name];
-                }
-            }
+        for (size_t i = locals.size(); i-- > callBase;) {
+            auto it = locals[i].find(name);
+            if (it != locals[i].end()) return it->second;
         }
-        if (globals.find(name) != globals.end()) {
-            return globals[name];
+        auto global = globals.find(name);
+        if (global != globals.end()) {
+            return global->second;
         } else {
             throw AuroraException("Undefined variable '" + name + "'.");
         }
     }
 
-    void setVariable(const std::string &name, const AuroraObj& value) {
-        if (locals.empty()) {
-            globals[name] = value;
+    void setVariable(const std::string &name, AuroraObj value) {
+        if (locals.size() == callBase) {
+            globals[name] = std::move(value);
             return;
         }
-        for (int i = locals.size() - 1; i >= 0; i--) {
-            if(locals[i].find(name) != locals[i].end()) {
-                locals[i][name] = value;
+        for (size_t i = locals.size(); i-- > callBase;) {
+            auto it = locals[i].find(name);
+            if (it != locals[i].end()) {
+                it->second = std::move(value);
                 return;
             }
         }
+        // blocks at the top level may update globals, functions bind a new local instead
+        if (callDepth == 0 && globals.find(name) != globals.end()) {
+            globals[name] = std::move(value);
+            return;
+        }
+        locals.back()[name] = std::move(value);
+    }
+
+    // the variable setVariable would assign, holding what lookupVariable would return
+    AuroraObj &assignable(const std::string &name) {
+        for (size_t i = locals.size(); i-- > callBase;) {
+            auto it = locals[i].find(name);
+            if (it != locals[i].end()) return it->second;
+        }
+        auto global = globals.find(name);
+        if (global == globals.end()) throw AuroraException("Undefined variable '" + name + "'.");
+        if (locals.size() == callBase || callDepth == 0) return global->second;
+        // a function reading a global binds its own copy
+        return locals.back()[name] = global->second;
     }
 
+    int callDepth = 0;
+
+    void pushFrame(AuroraFrame::Type type, const AuroraCodeUnit *unit);
+
+    // opens the scope of the frame just pushed
+    void pushScope();
+
+    // running out of memory growing frames or scopes, reported as a stack overflow
+    [[noreturn]] void overflow();
+
+    void bindArguments(const AuroraFunction &fn, int count);
+
+    bool nextIteration();
+
+    AuroraObj dispatch(size_t base, size_t stackBase, size_t localsBase);
+
+    // dispatches the frames above base, unwinding them if the script throws
+    AuroraObj enter(size_t base, size_t stackBase, size_t localsBase);
+
+    // executes the main unit, or continues it, under the heap limit, budget and instrumentation
+    void runSlice(bool resuming);
+
+    // Budget accounting: the dispatch loop only counts budgetCountdown down and calls budgetSpent
+    // when it goes negative, which accounts for the slice, checks the clock and starts the next.
+    static constexpr int64_t clockInterval = 1 << 16;
+    int64_t budgetCountdown = INT64_MAX, budgetSlice = INT64_MAX;
+    uint64_t budgetUsed = 0;
+    std::chrono::steady_clock::time_point deadline;
+
+    void startBudget();
+
+    // whether to suspend; throws AuroraBudgetException if the budget is spent and it can't
+    bool budgetSpent(size_t base);
+
+    // operand stack and locals base of the suspended top-level dispatch, if any
+    std::optional<std::pair<size_t, size_t>> suspendedAt;
+
+    // Green threads. Task 0 is the main script, created along with the first spawned task; until
+    // then the context runs exactly as it would without tasks. The running task's state lives in
+    // the context's own members and is swapped into its AuroraTask while others run.
+    static constexpr size_t noTask = SIZE_MAX;
+    std::vector<std::unique_ptr<AuroraTask>> tasks;
+    std::deque<size_t> readyTasks;
+    size_t runningTask = 0, liveTasks = 0;
+    AuroraObj lastResult;
+
+    // why the running task handed control back, set by budgetSpent and blocking or yielding natives
+    enum class Pause {
+        NONE, BUDGET, YIELD, BLOCK, EMIT
+    } pause = Pause::NONE;
+
+    // values for tasks blocked in receive, possibly from other threads, delivered at the next switch
+    std::mutex wakeMutex;
+    std::vector<std::pair<size_t, AuroraObj>> wakeups;
+    bool parked = false;
+
+    void reloadBudget();
+
+    // runs tasks until they've all finished, the budget is spent or every one of them is blocked
+    void schedule(bool resuming, size_t traceDepth);
+
+    void swapTask(AuroraTask &task);
+
+    void finishTask(size_t task, const AuroraObj &result);
+
+    void ensureTasks();
+
+    [[nodiscard]] size_t taskArgument(const std::vector<AuroraObj> &args) const;
+
+    // reopens tracer spans for the calls on the frame stack after switching to it
+    void traceFrames();
+
+    // Generators run on their own frame stack, swapped in like a task's, nested in the native call
+    // that pulled from them; they can't suspend the script or switch tasks until they hand back.
+    AuroraGenerator *activeGenerator = nullptr;
+
+    bool resumeGenerator(AuroraGenerator &generator, AuroraObj &out);
+
+    // CALL n; RET units by argument count, the bottom frame of call
+    std::unordered_map<int, std::unique_ptr<AuroraCodeUnit>> callEntries;
+
+    // hands the current frame stack to the profiler and perf counters, ip is about to execute in unit
+    void sample(const AuroraCodeUnit *unit, const ThreadedInstruction *ip);
+
 public:
     Token current;
 
-    AuroraObj execute(AuroraCodeUnit unit);
+    // rewrite proven sites to typed opcodes before executing
+    bool inferTypes = true;
+
+    // list the sites type inference could not prove on stderr
+    bool reportDynamicSites = false;
+
+    AuroraObj execute(const AuroraCodeUnit &main);
+
+    // deepest the frame stack may grow before a script is stopped with a stack overflow; a frame
+    // and its scope take about 650 bytes, so the default stays well within memory
+    size_t maxFrames = 1'000'000;
+
+    // function bodies by name, filled in as functions are compiled
+    std::unordered_map<const AuroraCodeUnit *, std::string> functionNames;
+
+    // receives samples while it's running, if set
+    AuroraProfiler *profiler = nullptr;
+
+    // opened counters to run around execution and attribute overflows with, if set
+    AuroraPerfCounters *perfCounters = nullptr;
+
+    // records phases, calls and native calls on a timeline, if set
+    AuroraTracer *tracer = nullptr;
+
+    // bytes of heap the script may have live, 0 for no limit; going over throws AuroraHeapLimitException
+    int64_t heapLimit = 0;
+
+    // what the script allocated and still has live, checked against heapLimit while it runs
+    AuroraHeapAccount heap;
+
+    // where to write a heap snapshot if the limit is hit, if anywhere
+    std::string heapSnapshotPath;
+
+    // globals, locals and the operand stack as a heap snapshot, see AuroraHeap
+    void writeHeapSnapshot(std::ostream &out) const;
+
+    // instructions run or resume may execute, 0 for no limit. Blocks, loop bodies and functions are
+    // charged their full length as they're entered, so this bounds rather than counts what runs.
+    uint64_t instructionBudget = 0;
+
+    // wall-clock time run or resume may take, 0 for no limit, checked every clockInterval instructions
+    std::chrono::nanoseconds timeBudget{0};
+
+    // when the budget is spent, suspend at the next back-edge or call instead of throwing
+    // AuroraBudgetException. Scripts running inside a native call or generator can't, they suspend
+    // at the first check once it returns.
+    bool yieldOnBudget = false;
+
+    [[nodiscard]] bool suspended() const { return suspendedAt.has_value(); }
+
+    // continues a suspended or blocked script with a fresh budget, returns whether it finished
+    bool resume();
+
+    // instructions a task runs before the next ready one gets its turn
+    int64_t taskSlice = 1 << 14;
+
+    // every task is waiting in await or receive; resume once a send has woken one
+    [[nodiscard]] bool blocked() const { return runningTask == noTask && liveTasks > 0; }
+
+    // for schedulers of blocked contexts: marks the context parked, so the next wakeup calls onWake.
+    // False if a wakeup already arrived and the context can be resumed straight away.
+    bool park();
+
+    // called, from the waking thread, when a parked context has a task to run again
+    std::function<void()> onWake;
+
+    // delivers value to a task blocked in receive, from any thread
+    void wake(size_t task, AuroraObj value);
 
-    explicit AuroraContext(std::string source, std::unordered_map<std::string, AuroraObj>& globals) : scanner(std::move(source)), current(scanner.nextToken()), globals(globals) {}
+    // the context running a script on this thread, for natives that act on it
+    static AuroraContext &running();
+
+    // calls a script or native function from a native, on top of the running script's frames
+    AuroraObj call(const AuroraObj &fn, const std::vector<AuroraObj> &args);
+
+    // builtins, see std_lib.h: spawn(fn, args...) starts fn as a task and returns its id,
+    // await(task) blocks until it finishes and returns its result, yield lets other tasks run,
+    // generator(fn, args...) makes an iterator over the values fn passes to emit(value), which
+    // hands each to whatever pulled from it, and receive(channel) blocks until a value is sent
+    AuroraObj spawn(const std::vector<AuroraObj> &args);
+
+    AuroraObj await(const std::vector<AuroraObj> &args);
+
+    AuroraObj yield(const std::vector<AuroraObj> &args);
+
+    AuroraObj emit(const std::vector<AuroraObj> &args);
+
+    AuroraObj generator(const std::vector<AuroraObj> &args);
+
+    AuroraObj receive(size_t channel);
+
+    // where print, write and writeln go, stdout unless redirected
+    AuroraOutput output;
+
+    // instructions dispatched, only counted in builds with AURORA_COUNT_INSTRUCTIONS
+    uint64_t instructionsExecuted = 0;
+
+    // phase timings, code size and allocations of run, if set
+    AuroraStats *stats = nullptr;
+
+    explicit AuroraContext(std::string source, std::unordered_map<std::string, AuroraObj>& globals) : scanner(std::move(source)), globals(globals), current(scanner.nextToken()) {}
+
+    ~AuroraContext() { AuroraChannel::forget(this); }
 
     void run();
 
@@ -71,20 +338,44 @@ public:
 
     void call();
 
+    // .field after the value compiled from start on, any number of times
+    void fields(size_t start);
+
+    // the constant a field opcode takes, see InstructionType::GET_FIELD; variable is empty for the
+    // opcodes that take the record from the stack
+    int fieldOperand(const std::string &variable, const std::string &field);
+
+    // field id to its offset in every struct this script declared so far that has it, -1 where
+    // they don't agree
+    std::unordered_map<int, int> fieldOffsets;
+
     void unary();
 
     void factor();
 
     void term();
 
+    // the last chain of + that term compiled: where it starts, where its first operand ends, its ADDs
+    struct {
+        size_t start = 0, firstEnd = 0;
+        std::vector<size_t> adds;
+    } lastSum;
+
+    // compiles name = name + a + b..., whose code ends with the last sum, to an APPEND
+    bool appendSum(const std::string &name, size_t start);
+
     void comparison();
 
     void equality();
 
-    void andExpr();
+    void patch(const std::vector<int> &jumps);
+
+    bool logical(std::vector<int> &whenTrue, std::vector<int> &whenFalse);
 
     void expression();
 
+    void ifBranches(int blocks, const std::vector<int> &whenTrue, const std::vector<int> &whenFalse);
+
     void if_statement();
 
     void while_statement();
@@ -93,6 +384,10 @@ public:
 
     void function_statement();
 
+    void struct_statement();
+
+    void tailCall();
+
     static bool isAssignOp(TokenType type) {
         return type == TokenType::ASSIGN
                || type == TokenType::PLUS_ASSIGN
@@ -0,0 +1,145 @@
+#include "file.h"
+#include "iterator.h"
+#include "output.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+    [[noreturn]] void fail(const std::string &what, const std::string &path) {
+        throw AuroraException("Couldn't " + what + " " + path + ": " + std::strerror(errno) + ".");
+    }
+
+    struct Lines : AuroraIterator {
+        std::shared_ptr<AuroraFile::Mapping> mapping;
+        size_t position = 0;
+
+        explicit Lines(std::shared_ptr<AuroraFile::Mapping> mapping) : mapping(std::move(mapping)) {}
+
+        bool next(AuroraObj &out) override {
+            auto text = mapping->text();
+            if (position >= text.size()) return false;
+            size_t end = text.find('\n', position);
+            if (end == std::string_view::npos) end = text.size();
+            out = AuroraObj(std::string(text.substr(position, end - position)));
+            position = end + 1;
+            return true;
+        }
+    };
+
+    // shared by copies of the writer, so closing one closes them all
+    struct Writer {
+        struct State {
+            AuroraOutput output;
+            bool closed = false;
+        };
+        std::shared_ptr<State> state;
+
+        AuroraObj operator()(const std::vector<AuroraObj> &args) const {
+            if (state->closed) throw AuroraException("Can't write to a closed file.");
+            for (auto &arg: args) state->output.write(arg);
+            return AuroraObj();
+        }
+    };
+}
+
+AuroraFile::Mapping::~Mapping() {
+    if (size > 0) munmap(const_cast<char *>(data), size);
+}
+
+std::shared_ptr<AuroraFile::Mapping> AuroraFile::map(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) fail("open", path);
+    struct stat status{};
+    if (fstat(fd, &status) < 0) {
+        ::close(fd);
+        fail("read", path);
+    }
+    auto mapping = std::make_shared<Mapping>();
+    // nothing to map in an empty file
+    if (status.st_size > 0) {
+        void *data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            fail("map", path);
+        }
+        madvise(data, status.st_size, MADV_SEQUENTIAL);
+        mapping->data = static_cast<const char *>(data);
+        mapping->size = status.st_size;
+    }
+    // the mapping keeps the file around
+    ::close(fd);
+    return mapping;
+}
+
+AuroraObj AuroraFile::read(const std::string &path) {
+    return AuroraObj(std::string(map(path)->text()));
+}
+
+AuroraObj AuroraFile::lines(const std::string &path) {
+    return AuroraIterator::make(std::make_shared<Lines>(map(path)));
+}
+
+void AuroraFile::write(const std::string &path, const std::vector<AuroraObj> &values, size_t first) {
+    // strings are written from where they are, everything else is formatted into one scratch buffer
+    std::string scratch;
+    std::vector<std::pair<size_t, size_t>> formatted(values.size());
+    for (size_t i = first; i < values.size(); i++) {
+        if (values[i].value.index() == 1) continue;
+        formatted[i].first = scratch.size();
+        values[i].appendTo(scratch);
+        formatted[i].second = scratch.size() - formatted[i].first;
+    }
+    std::vector<iovec> pieces;
+    for (size_t i = first; i < values.size(); i++) {
+        if (values[i].value.index() == 1) {
+            auto &str = values[i].asStringUnchecked();
+            if (!str.empty()) pieces.push_back({const_cast<char *>(str.data()), str.size()});
+        } else if (formatted[i].second > 0)
+            pieces.push_back({scratch.data() + formatted[i].first, formatted[i].second});
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) fail("open", path);
+    size_t next = 0;
+    while (next < pieces.size()) {
+        ssize_t written = writev(fd, pieces.data() + next, (int) std::min<size_t>(pieces.size() - next, IOV_MAX));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            ::close(fd);
+            errno = error;
+            fail("write", path);
+        }
+        // skip what was written, which may end partway through a piece
+        while (next < pieces.size() && (size_t) written >= pieces[next].iov_len) written -= pieces[next++].iov_len;
+        if (next < pieces.size()) {
+            pieces[next].iov_base = static_cast<char *>(pieces[next].iov_base) + written;
+            pieces[next].iov_len -= written;
+        }
+    }
+    if (::close(fd) < 0) fail("write", path);
+}
+
+AuroraObj AuroraFile::open(const std::string &path) {
+    auto state = std::make_shared<Writer::State>();
+    state->output.policy = AuroraOutput::Flush::EXIT;
+    state->output.toFile(path);
+    return AuroraObj(AuroraNativeFunction(Writer{std::move(state)}));
+}
+
+bool AuroraFile::close(const AuroraObj &writer) {
+    if (writer.value.index() != 7) return false;
+    auto target = writer.asNativeFunctionUnchecked().target<Writer>();
+    if (!target) return false;
+    auto &state = *target->state;
+    if (state.closed) return true;
+    state.closed = true;
+    // the sink closes the file as it's replaced
+    state.output.discard();
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef AURORA_FILE_H
+#define AURORA_FILE_H
+
+#include <memory>
+#include <string_view>
+#include "aurora_obj.h"
+
+// File builtins. Files read are mapped rather than read, so scanning one runs at page cache speed
+// and only what the script keeps is copied out. Files written go out in large batches: write_file
+// hands every value to a single writev, and open returns a writer buffered like script output.
+struct AuroraFile {
+    // a file mapped read-only, unmapped once nothing reads from it
+    struct Mapping {
+        const char *data = nullptr;
+        size_t size = 0;
+
+        Mapping() = default;
+
+        Mapping(const Mapping &) = delete;
+
+        Mapping &operator=(const Mapping &) = delete;
+
+        ~Mapping();
+
+        [[nodiscard]] std::string_view text() const { return {data, size}; }
+    };
+
+    static std::shared_ptr<Mapping> map(const std::string &path);
+
+    // the whole file as a string
+    static AuroraObj read(const std::string &path);
+
+    // an iterator over the file's lines, without their newlines
+    static AuroraObj lines(const std::string &path);
+
+    // replaces the file's contents with values, formatted as print would but without the newline
+    static void write(const std::string &path, const std::vector<AuroraObj> &values, size_t first);
+
+    // a writer to the truncated file: calling it writes its arguments as write does
+    static AuroraObj open(const std::string &path);
+
+    // flushes and closes writer, false if it isn't one
+    static bool close(const AuroraObj &writer);
+};
+
+#endif //AURORA_FILE_H
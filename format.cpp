@@ -0,0 +1,116 @@
+#include "format.h"
+#include "aurora_obj.h"
+#include "map.h"
+#include "record.h"
+#include <charconv>
+#include <cmath>
+
+char *AuroraFormat::number(double number, char *out) {
+    char *end = out + numberSize;
+    double magnitude = std::fabs(number);
+    // most numbers scripts print are counts and indices; -0 isn't one
+    bool whole = magnitude < 9007199254740992.0 && number == (double) (long long) number;
+    if (whole && !(number == 0 && std::signbit(number)))
+        return std::to_chars(out, end, (long long) number).ptr;
+    if (magnitude == 0 || (magnitude >= 1e-6 && magnitude < 1e21))
+        return std::to_chars(out, end, number, std::chars_format::fixed).ptr;
+    return std::to_chars(out, end, number, std::chars_format::scientific).ptr;
+}
+
+std::string AuroraFormat::fill(std::string_view pattern, const std::vector<AuroraObj> &args, size_t first) {
+    // strings are copied from where they are, everything else is formatted into one scratch buffer
+    std::string scratch;
+    std::vector<std::pair<size_t, size_t>> formatted(args.size());
+    size_t size = pattern.size();
+    for (size_t i = first; i < args.size(); i++) {
+        if (args[i].value.index() == 1) {
+            size += args[i].asStringUnchecked().size();
+            continue;
+        }
+        formatted[i].first = scratch.size();
+        args[i].appendTo(scratch);
+        formatted[i].second = scratch.size() - formatted[i].first;
+        size += formatted[i].second;
+    }
+    std::string out;
+    out.reserve(size);
+    size_t next = first;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        char c = pattern[i];
+        if ((c == '{' || c == '}') && i + 1 < pattern.size() && pattern[i + 1] == c) {
+            out += c;
+            i++;
+        } else if (c == '{' && i + 1 < pattern.size() && pattern[i + 1] == '}') {
+            if (next == args.size()) throw AuroraException("Not enough arguments for format.");
+            if (args[next].value.index() == 1) out += args[next].asStringUnchecked();
+            else out.append(scratch, formatted[next].first, formatted[next].second);
+            next++;
+            i++;
+        } else if (c == '{' || c == '}') throw AuroraException("Unmatched brace in format.");
+        else out += c;
+    }
+    if (next != args.size()) throw AuroraException("Too many arguments for format.");
+    return out;
+}
+
+void AuroraObj::appendTo(std::string &out) const {
+    switch (value.index()) {
+        case 0: {
+            char text[AuroraFormat::numberSize];
+            out.append(text, AuroraFormat::number(std::get<double>(value), text));
+            return;
+        }
+        case 1:
+            out += std::get<std::string>(value);
+            return;
+        case 2:
+            out += std::get<bool>(value) ? "true" : "false";
+            return;
+        case 3: {
+            auto &list = std::get<AuroraList>(value);
+            if (list.empty()) {
+                out += "[]";
+                return;
+            }
+            out += '{';
+            if (list.packed()) {
+                char buffer[AuroraFormat::numberSize];
+                for (size_t i = 0; i < list.size(); i++) {
+                    if (i > 0) out += ", ";
+                    out.append(buffer, AuroraFormat::number(list.numbers()[i], buffer));
+                }
+            } else {
+                auto &values = list.values();
+                for (size_t i = 0; i < values.size(); i++) {
+                    if (i > 0) out += ", ";
+                    values[i].appendTo(out);
+                }
+            }
+            out += '}';
+            return;
+        }
+        case 4:
+            out += "function";
+            return;
+        case 5:
+            out += "code unit";
+            return;
+        case 6:
+            out += "null";
+            return;
+        case 7:
+            out += "native function";
+            return;
+        case 8:
+            AuroraMap::from(*this).appendTo(out);
+            return;
+        case 9:
+            AuroraRecord::from(*this).appendTo(out);
+            return;
+        case 10:
+            out += "iterator";
+            return;
+        default:
+            throw AuroraException("Invalid AuroraObj type.");
+    }
+}
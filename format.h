@@ -0,0 +1,26 @@
+#ifndef AURORA_FORMAT_H
+#define AURORA_FORMAT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct AuroraObj;
+
+// Number formatting for to_string, print and everything else that turns values into text.
+struct AuroraFormat {
+    // room number needs, sign and terminator included
+    static constexpr size_t numberSize = 40;
+
+    // Writes the shortest text that reads back as exactly number, returning its end. Whole numbers
+    // up to 2^53 are written as integers, the rest in fixed notation from 1e-6 up to 1e21 and in
+    // scientific notation outside it.
+    static char *number(double number, char *out);
+
+    // pattern with each {} replaced by the next of args from first on, {{ and }} standing for braces;
+    // the result is allocated once, at its final size
+    static std::string fill(std::string_view pattern, const std::vector<AuroraObj> &args, size_t first);
+};
+
+#endif //AURORA_FORMAT_H
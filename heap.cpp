@@ -0,0 +1,205 @@
+#include "heap.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    struct Site {
+        const std::string *function;
+        int line;
+
+        // by address, function names may be gone by the time the last values are released
+        bool operator<(const Site &other) const {
+            return std::tie(function, line) < std::tie(other.function, other.line);
+        }
+    };
+
+    struct Usage {
+        int64_t count = 0, bytes = 0;
+    };
+
+    const std::string *compiling = new std::string("<compile>");
+    Site current{compiling, 0};
+    // never destroyed, values in other static objects are released during exit
+    auto &buffers = *new std::unordered_map<const void *, std::pair<Site, size_t>>;
+    auto &sites = *new std::map<Site, Usage>;
+
+    // takes size off live without going below 0, since values made before accounting was enabled,
+    // or by another context, were never counted
+    void drop(std::atomic<int64_t> &live, int64_t size) {
+        int64_t now = live.load(std::memory_order_relaxed);
+        while (!live.compare_exchange_weak(now, std::max<int64_t>(0, now - size), std::memory_order_relaxed)) {}
+    }
+}
+
+void AuroraAllocations::record(const AuroraObj &obj) {
+    auto [data, size] = buffer(obj);
+    if (size != 0) record(obj.value.index(), data, size);
+}
+
+void AuroraAllocations::release(const AuroraObj &obj) {
+    auto [data, size] = buffer(obj);
+    if (size != 0) release(obj.value.index(), data, size);
+}
+
+void AuroraAllocations::record(size_t kind, const void *data, size_t size) {
+    if (account) {
+        if (account->live + (int64_t) size > account->limit) {
+            throw AuroraHeapLimitException("Heap limit exceeded, allocating " + std::to_string(size) + " bytes with " +
+                                           std::to_string(account->live) + " of " + std::to_string(account->limit) +
+                                           " in use.");
+        }
+        account->live += (int64_t) size;
+    }
+    counts[kind].fetch_add(1, std::memory_order_relaxed);
+    bytes[kind].fetch_add(size, std::memory_order_relaxed);
+    live[kind].fetch_add((int64_t) size, std::memory_order_relaxed);
+    liveTotal.fetch_add((int64_t) size, std::memory_order_relaxed);
+    if (trackSites) recordSite(data, size, kind);
+}
+
+void AuroraAllocations::release(size_t kind, const void *data, size_t size) {
+    if (account) account->live = std::max<int64_t>(0, account->live - (int64_t) size);
+    drop(live[kind], (int64_t) size);
+    drop(liveTotal, (int64_t) size);
+    if (trackSites) releaseSite(data);
+}
+
+void AuroraAllocations::recordSite(const void *buffer, size_t size, size_t) {
+    buffers[buffer] = {current, size};
+    auto &usage = sites[current];
+    usage.count++;
+    usage.bytes += size;
+}
+
+void AuroraAllocations::releaseSite(const void *buffer) {
+    auto it = buffers.find(buffer);
+    if (it == buffers.end()) return;
+    auto &usage = sites[it->second.first];
+    usage.count--;
+    usage.bytes -= it->second.second;
+    buffers.erase(it);
+}
+
+void AuroraHeap::setSite(const std::string *function, int line) {
+    current = {function, line};
+}
+
+std::string AuroraHeap::siteOf(const void *buffer) {
+    auto it = buffers.find(buffer);
+    if (it == buffers.end()) return "";
+    return *it->second.first.function + ":" + std::to_string(it->second.first.line);
+}
+
+void AuroraHeap::writeReport(std::ostream &out, const AuroraHeapAccount &account, size_t top) {
+    out << "live heap " << AuroraAllocations::liveTotal.load() << " bytes";
+    if (account.limit != INT64_MAX) out << ", the script's " << account.live << " of " << account.limit;
+    out << "\n";
+    for (int kind: {1, 3, 4, 5, 8, 9}) {
+        out << "  " << variantIndexToString(kind) << ": " << AuroraAllocations::live[kind].load() << " bytes\n";
+    }
+    std::vector<std::pair<Site, Usage>> ranked;
+    for (const auto &[site, usage]: sites) {
+        if (usage.bytes > 0) ranked.emplace_back(site, usage);
+    }
+    if (ranked.empty()) return;
+    std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+        return a.second.bytes > b.second.bytes;
+    });
+    out << "top allocation sites by live bytes\n";
+    for (size_t i = 0; i < ranked.size() && i < top; i++) {
+        out << "  " << *ranked[i].first.function << ":" << ranked[i].first.line << "  " << ranked[i].second.bytes
+            << " bytes in " << ranked[i].second.count << " values\n";
+    }
+}
+
+static void writeJsonString(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (char c: str) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if (c == '\n') out << "\\n";
+        else if ((unsigned char) c >= 0x20) out << c;
+    }
+    out << '"';
+}
+
+namespace {
+    // values that own heap memory, directly or through their elements
+    struct Node {
+        std::string name;
+        const AuroraObj *value;
+        size_t self = 0, retained = 0;
+        std::vector<Node> children;
+    };
+
+    Node build(const std::string &name, const AuroraObj &value, std::unordered_set<const AuroraCodeUnit *> &seen) {
+        Node node{name, &value, 0, 0, {}};
+        node.self = AuroraAllocations::buffer(value).second;
+        auto add = [&](const std::string &childName, const AuroraObj &child) {
+            Node childNode = build(childName, child, seen);
+            if (childNode.retained == 0) return;
+            node.retained += childNode.retained;
+            node.children.push_back(std::move(childNode));
+        };
+        if (value.value.index() == 3 && !value.asListUnchecked().packed()) {
+            // a packed list's numbers are all in its own buffer
+            auto &elements = value.asListUnchecked().values();
+            for (size_t i = 0; i < elements.size(); i++) add(std::to_string(i), elements[i]);
+        } else if (value.value.index() == 4) {
+            // function bodies are shared between copies of the function, count each once
+            const AuroraCodeUnit *unit = std::get<AuroraFunction>(value.value).code.get();
+            if (seen.insert(unit).second) {
+                node.self += unit->instructions.capacity() * sizeof(Instruction) +
+                             unit->constants.capacity() * sizeof(AuroraObj);
+                for (size_t i = 0; i < unit->constants.size(); i++) add("constant " + std::to_string(i), unit->constants[i]);
+            }
+        } else if (value.value.index() == 5) {
+            auto &unit = std::get<AuroraCodeUnit>(value.value);
+            for (size_t i = 0; i < unit.constants.size(); i++) add("constant " + std::to_string(i), unit.constants[i]);
+        }
+        node.retained += node.self;
+        return node;
+    }
+
+    void write(std::ostream &out, const Node &node, int indent) {
+        std::string pad(indent, ' ');
+        out << pad << "{\"name\": ";
+        writeJsonString(out, node.name);
+        out << ", \"kind\": \"" << variantIndexToString(node.value->value.index()) << "\", \"self\": " << node.self
+            << ", \"retained\": " << node.retained;
+        auto site = AuroraHeap::siteOf(AuroraAllocations::buffer(*node.value).first);
+        if (!site.empty()) {
+            out << ", \"site\": ";
+            writeJsonString(out, site);
+        }
+        if (!node.children.empty()) {
+            out << ", \"children\": [\n";
+            for (size_t i = 0; i < node.children.size(); i++) {
+                write(out, node.children[i], indent + 2);
+                out << (i + 1 < node.children.size() ? ",\n" : "\n");
+            }
+            out << pad << "]";
+        }
+        out << "}";
+    }
+}
+
+void AuroraHeap::writeSnapshot(std::ostream &out, const std::vector<std::pair<std::string, const AuroraObj *>> &roots) {
+    std::unordered_set<const AuroraCodeUnit *> seen;
+    std::vector<Node> nodes;
+    size_t total = 0;
+    for (const auto &[name, value]: roots) {
+        Node node = build(name, *value, seen);
+        if (node.retained == 0) continue;
+        total += node.retained;
+        nodes.push_back(std::move(node));
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const Node &a, const Node &b) { return a.retained > b.retained; });
+    out << "{\"retained\": " << total << ", \"roots\": [\n";
+    for (size_t i = 0; i < nodes.size(); i++) {
+        write(out, nodes[i], 2);
+        out << (i + 1 < nodes.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
@@ -0,0 +1,27 @@
+#ifndef AURORA_HEAP_H
+#define AURORA_HEAP_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "aurora_obj.h"
+
+// Live heap by allocation site, and heap snapshots. Sites are only known while
+// AuroraAllocations::trackSites is on, the dispatch loop then keeps the current one up to date.
+struct AuroraHeap {
+    // where values made from now on are allocated
+    static void setSite(const std::string *function, int line);
+
+    // "function:line" of the live buffer, empty if it wasn't tracked
+    static std::string siteOf(const void *buffer);
+
+    // live bytes by value kind, the script's against its limit if it has one, and the top sites
+    // by live bytes
+    static void writeReport(std::ostream &out, const AuroraHeapAccount &account, size_t top = 20);
+
+    // every root's object graph as JSON, with each value's own and retained size; values are
+    // copied rather than shared, so the graph is a tree and retained size is the subtree's
+    static void writeSnapshot(std::ostream &out, const std::vector<std::pair<std::string, const AuroraObj *>> &roots);
+};
+
+#endif //AURORA_HEAP_H
@@ -0,0 +1,132 @@
+#include "input.h"
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <unistd.h>
+
+AuroraInput &AuroraInput::standard() {
+    // never destroyed, scripts in static contexts may still read during exit
+    static auto &input = *new AuroraInput(STDIN_FILENO);
+    return input;
+}
+
+bool AuroraInput::fill() {
+    if (exhausted) return false;
+    if (start > 0) {
+        std::memmove(buffer.data(), buffer.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    if (end == buffer.size()) buffer.resize(buffer.size() * 2);
+    for (;;) {
+        ssize_t count = read(fd, buffer.data() + end, buffer.size() - end);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) throw AuroraException(std::string("Couldn't read input: ") + std::strerror(errno) + ".");
+        if (count == 0) {
+            exhausted = true;
+            return false;
+        }
+        end += count;
+        return true;
+    }
+}
+
+bool AuroraInput::line(std::string &out) {
+    std::lock_guard lock(mutex);
+    size_t scanned = 0; // past start, survives fill moving the bytes
+    for (;;) {
+        const char *from = buffer.data() + start + scanned;
+        auto found = static_cast<const char *>(std::memchr(from, '\n', end - start - scanned));
+        if (found) {
+            out.assign(buffer.data() + start, found - buffer.data() - start);
+            start = found - buffer.data() + 1;
+            return true;
+        }
+        scanned = end - start;
+        if (fill()) continue;
+        // the last line needn't end in a newline
+        if (start == end) return false;
+        out.assign(buffer.data() + start, end - start);
+        start = end;
+        return true;
+    }
+}
+
+bool AuroraInput::until(char delim, std::string &out) {
+    std::lock_guard lock(mutex);
+    size_t scanned = 0;
+    for (;;) {
+        const char *from = buffer.data() + start + scanned;
+        auto found = static_cast<const char *>(std::memchr(from, delim, end - start - scanned));
+        if (found) {
+            out.assign(buffer.data() + start, found - buffer.data() - start);
+            start = found - buffer.data() + 1;
+            return true;
+        }
+        scanned = end - start;
+        if (fill()) continue;
+        start = end;
+        return false;
+    }
+}
+
+bool AuroraInput::nextWord(std::string_view &out) {
+    for (;;) {
+        while (start < end && std::isspace((unsigned char) buffer[start])) start++;
+        if (start < end) break;
+        if (!fill()) return false;
+    }
+    size_t length = 0;
+    for (;;) {
+        while (start + length < end && !std::isspace((unsigned char) buffer[start + length])) length++;
+        if (start + length < end || !fill()) break;
+    }
+    out = std::string_view(buffer.data() + start, length);
+    start += length;
+    return true;
+}
+
+bool AuroraInput::word(std::string &out) {
+    std::lock_guard lock(mutex);
+    std::string_view found;
+    if (!nextWord(found)) return false;
+    out.assign(found);
+    return true;
+}
+
+std::string AuroraInput::all() {
+    std::lock_guard lock(mutex);
+    while (fill());
+    std::string rest(buffer.data() + start, end - start);
+    start = end = 0;
+    return rest;
+}
+
+std::vector<double> AuroraInput::numbers() {
+    std::lock_guard lock(mutex);
+    std::vector<double> numbers;
+    std::string_view found;
+    while (nextWord(found)) {
+        double number;
+        auto text = found.substr(!found.empty() && found[0] == '+');
+        auto [parsed, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+        if (error != std::errc() || parsed != text.data() + text.size())
+            throw AuroraException("Expected a number, got '" + std::string(found) + "'.");
+        numbers.push_back(number);
+    }
+    return numbers;
+}
+
+double AuroraInput::parseNumber(std::string_view text) {
+    while (!text.empty() && std::isspace((unsigned char) text[0])) text.remove_prefix(1);
+    if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+    double number;
+    auto error = std::from_chars(text.data(), text.data() + text.size(), number).ec;
+    // strtod rounds to infinity or zero where from_chars gives up
+    if (error == std::errc::result_out_of_range) return std::strtod(std::string(text).c_str(), nullptr);
+    if (error != std::errc()) return std::numeric_limits<double>::quiet_NaN();
+    return number;
+}
@@ -0,0 +1,54 @@
+#ifndef AURORA_INPUT_H
+#define AURORA_INPUT_H
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "aurora_obj.h"
+
+// Buffered reads from a file descriptor, scanned in place: lines, tokens and numbers are found in
+// the buffer and copied out once, if at all. Every input builtin reads through standard(), which
+// shares stdin between contexts on any thread; hosts reading std::cin alongside would lose input
+// the buffer has already taken.
+class AuroraInput {
+public:
+    explicit AuroraInput(int fd) : fd(fd), buffer(initialSize) {}
+
+    static AuroraInput &standard();
+
+    // the next line without its newline, false once input is exhausted
+    bool line(std::string &out);
+
+    // the next whitespace-delimited word, false if there are none left
+    bool word(std::string &out);
+
+    // everything up to the next delim, which is consumed, false if input ends first
+    bool until(char delim, std::string &out);
+
+    // the rest of the input
+    std::string all();
+
+    // the rest of the input as whitespace-separated numbers, throws at anything else
+    std::vector<double> numbers();
+
+    // the number text starts with, like stod, or NaN if it doesn't start with one
+    static double parseNumber(std::string_view text);
+
+private:
+    static constexpr size_t initialSize = 1 << 20;
+    int fd;
+    std::mutex mutex;
+    std::vector<char> buffer;
+    size_t start = 0, end = 0; // unread bytes
+    bool exhausted = false;
+
+    // reads more after the unread bytes, moving them to the front or growing the buffer for room;
+    // false at end of input
+    bool fill();
+
+    // scans past whitespace, then a word, which stays valid until the next fill
+    bool nextWord(std::string_view &out);
+};
+
+#endif //AURORA_INPUT_H
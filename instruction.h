@@ -6,6 +6,7 @@
 #define AURORA_INSTRUCTION_H
 
 #include <vector>
+#include <string>
 
 enum class InstructionType {
     PUSH,
@@ -20,8 +21,6 @@ enum class InstructionType {
     MOD,
     NEG,
     NOT,
-    AND,
-    OR,
     EQ,
     NEQ,
     LT,
@@ -42,12 +41,142 @@ enum class InstructionType {
     CONTINUE,
     DUP,
     LIST,
-    END
+    // builds a map from the operand's count of key, value pairs
+    MAP,
+    END,
+    TAILCALL,
+    // forward jumps, the operand is the target's index in the code unit
+    JMP,
+    JMPF,
+    JMPT,
+    BLOCK,
+    // adds the values on top of the stack to a variable in place, for x += a and x = x + a + b; the
+    // operand is a constant {name, count}
+    APPEND,
+    // indexes a variable where it is, for name:i, instead of copying all of it onto the stack first;
+    // the operand is the name's constant
+    LOAD_IDX,
+    // LOAD_IDX for compound index assignment, where a map's missing entry reads as 0, so that
+    // counts can start with m: key += 1
+    LOAD_ENTRY,
+    // record fields, for obj.field; the operand is a constant {field, id, offset}, where offset is
+    // where the compiler expects the field to be. GET_FIELD and SET_FIELD take the record from the
+    // stack, LOAD_FIELD and STORE_FIELD from a variable, named first in the constant
+    GET_FIELD,
+    SET_FIELD,
+    LOAD_FIELD,
+    STORE_FIELD,
+    // typed variants, emitted by AuroraTypeInference where the operand types are proven
+    ADD_NUM,
+    ADD_STR,
+    SUB_NUM,
+    MUL_NUM,
+    DIV_NUM,
+    MOD_NUM,
+    NEG_NUM,
+    NOT_BOOL,
+    EQ_NUM,
+    NEQ_NUM,
+    LT_NUM,
+    GT_NUM,
+    LTE_NUM,
+    GTE_NUM,
+    IDX_LIST,
+    IDX_STR,
+    CALL_FN,
+    CALL_NATIVE
 };
 
+// one past the last opcode, for tables indexed by InstructionType
+constexpr int instructionTypeCount = (int)InstructionType::CALL_NATIVE + 1;
+
 struct  __attribute__ ((packed)) Instruction {
     InstructionType type;
     int operand;
 };
 
+struct AuroraObj;
+
+// an Instruction decoded for direct-threaded dispatch
+struct ThreadedInstruction {
+    void *handler;
+    InstructionType type;
+    union {
+        int operand;
+        double number; // PUSHI
+        const AuroraObj *constant; // PUSH, LOAD, STORE, BLOCK, APPEND, LOAD_IDX, LOAD_ENTRY, the field opcodes, and the first code unit of IF, WLOOP and FLOOP
+        const ThreadedInstruction *target; // jumps, one before the target since dispatch pre-increments
+    };
+};
+
+inline std::string instructionTypeToString(InstructionType type) {
+    switch (type) {
+        case InstructionType::PUSH: return "PUSH";
+        case InstructionType::PUSHI: return "PUSHI";
+        case InstructionType::TRUE: return "TRUE";
+        case InstructionType::FALSE: return "FALSE";
+        case InstructionType::POP: return "POP";
+        case InstructionType::ADD: return "ADD";
+        case InstructionType::SUB: return "SUB";
+        case InstructionType::MUL: return "MUL";
+        case InstructionType::DIV: return "DIV";
+        case InstructionType::MOD: return "MOD";
+        case InstructionType::NEG: return "NEG";
+        case InstructionType::NOT: return "NOT";
+        case InstructionType::EQ: return "EQ";
+        case InstructionType::NEQ: return "NEQ";
+        case InstructionType::LT: return "LT";
+        case InstructionType::GT: return "GT";
+        case InstructionType::LTE: return "LTE";
+        case InstructionType::GTE: return "GTE";
+        case InstructionType::CALL: return "CALL";
+        case InstructionType::RET: return "RET";
+        case InstructionType::RES: return "RES";
+        case InstructionType::LOAD: return "LOAD";
+        case InstructionType::STORE: return "STORE";
+        case InstructionType::IF: return "IF";
+        case InstructionType::FLOOP: return "FLOOP";
+        case InstructionType::WLOOP: return "WLOOP";
+        case InstructionType::IDX: return "IDX";
+        case InstructionType::SETIDX: return "SETIDX";
+        case InstructionType::BREAK: return "BREAK";
+        case InstructionType::CONTINUE: return "CONTINUE";
+        case InstructionType::DUP: return "DUP";
+        case InstructionType::LIST: return "LIST";
+        case InstructionType::MAP: return "MAP";
+        case InstructionType::END: return "END";
+        case InstructionType::TAILCALL: return "TAILCALL";
+        case InstructionType::JMP: return "JMP";
+        case InstructionType::JMPF: return "JMPF";
+        case InstructionType::JMPT: return "JMPT";
+        case InstructionType::BLOCK: return "BLOCK";
+        case InstructionType::APPEND: return "APPEND";
+        case InstructionType::LOAD_IDX: return "LOAD_IDX";
+        case InstructionType::LOAD_ENTRY: return "LOAD_ENTRY";
+        case InstructionType::GET_FIELD: return "GET_FIELD";
+        case InstructionType::SET_FIELD: return "SET_FIELD";
+        case InstructionType::LOAD_FIELD: return "LOAD_FIELD";
+        case InstructionType::STORE_FIELD: return "STORE_FIELD";
+        case InstructionType::ADD_NUM: return "ADD_NUM";
+        case InstructionType::ADD_STR: return "ADD_STR";
+        case InstructionType::SUB_NUM: return "SUB_NUM";
+        case InstructionType::MUL_NUM: return "MUL_NUM";
+        case InstructionType::DIV_NUM: return "DIV_NUM";
+        case InstructionType::MOD_NUM: return "MOD_NUM";
+        case InstructionType::NEG_NUM: return "NEG_NUM";
+        case InstructionType::NOT_BOOL: return "NOT_BOOL";
+        case InstructionType::EQ_NUM: return "EQ_NUM";
+        case InstructionType::NEQ_NUM: return "NEQ_NUM";
+        case InstructionType::LT_NUM: return "LT_NUM";
+        case InstructionType::GT_NUM: return "GT_NUM";
+        case InstructionType::LTE_NUM: return "LTE_NUM";
+        case InstructionType::GTE_NUM: return "GTE_NUM";
+        case InstructionType::IDX_LIST: return "IDX_LIST";
+        case InstructionType::IDX_STR: return "IDX_STR";
+        case InstructionType::CALL_FN: return "CALL_FN";
+        case InstructionType::CALL_NATIVE: return "CALL_NATIVE";
+    }
+    return "UNKNOWN";
+}
+
 #endif //AURORA_INSTRUCTION_H
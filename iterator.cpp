@@ -0,0 +1,127 @@
+#include "iterator.h"
+#include "context.h"
+#include "input.h"
+
+namespace {
+    // lists and strings are values, so the iterator keeps its own copy to walk
+    struct Elements : AuroraIterator {
+        AuroraObj iterable;
+        size_t index = 0;
+
+        explicit Elements(AuroraObj iterable) : iterable(std::move(iterable)) {}
+
+        bool next(AuroraObj &out) override {
+            if (iterable.value.index() == 3) {
+                auto &list = iterable.asListUnchecked();
+                if (index >= list.size()) return false;
+                out = list[index++];
+            } else {
+                auto &str = iterable.asStringUnchecked();
+                if (index >= str.size()) return false;
+                out = AuroraObj::character(str[index++]);
+            }
+            return true;
+        }
+    };
+
+    struct Map : AuroraIterator {
+        std::shared_ptr<AuroraIterator> from;
+        AuroraObj fn;
+
+        Map(std::shared_ptr<AuroraIterator> from, AuroraObj fn) : from(std::move(from)), fn(std::move(fn)) {}
+
+        bool next(AuroraObj &out) override {
+            AuroraObj element;
+            if (!from->next(element)) return false;
+            out = AuroraContext::running().call(fn, {std::move(element)});
+            return true;
+        }
+    };
+
+    struct Filter : AuroraIterator {
+        std::shared_ptr<AuroraIterator> from;
+        AuroraObj fn;
+
+        Filter(std::shared_ptr<AuroraIterator> from, AuroraObj fn) : from(std::move(from)), fn(std::move(fn)) {}
+
+        bool next(AuroraObj &out) override {
+            while (from->next(out)) {
+                AuroraObj keep = AuroraContext::running().call(fn, {out});
+                if (keep.asBool()) return true;
+            }
+            return false;
+        }
+    };
+
+    struct Take : AuroraIterator {
+        std::shared_ptr<AuroraIterator> from;
+        size_t left;
+
+        Take(std::shared_ptr<AuroraIterator> from, size_t left) : from(std::move(from)), left(left) {}
+
+        bool next(AuroraObj &out) override {
+            // stop pulling from the source as soon as enough were taken, it may be endless
+            if (left == 0) return false;
+            left--;
+            return from->next(out);
+        }
+    };
+
+    struct Lines : AuroraIterator {
+        bool next(AuroraObj &out) override {
+            AuroraContext::running().output.beforeInput();
+            std::string line;
+            if (!AuroraInput::standard().line(line)) return false;
+            out = AuroraObj(std::move(line));
+            return true;
+        }
+    };
+}
+
+AuroraObj AuroraIterator::make(std::shared_ptr<AuroraIterator> iterator) {
+    return AuroraObj(std::move(iterator));
+}
+
+std::shared_ptr<AuroraIterator> AuroraIterator::of(const AuroraObj &obj) {
+    auto iterator = std::get_if<std::shared_ptr<AuroraIterator>>(&obj.value);
+    return iterator ? *iterator : nullptr;
+}
+
+std::shared_ptr<AuroraIterator> AuroraIterator::over(const AuroraObj &obj) {
+    if (obj.value.index() == 3 || obj.value.index() == 1) return std::make_shared<Elements>(obj);
+    if (auto source = of(obj)) return source;
+    throw AuroraException("Expected list, string or iterator, got " + variantIndexToString(obj.value.index()) + ".");
+}
+
+AuroraObj AuroraIterator::call(const AuroraObj &obj, size_t arguments) {
+    if (arguments != 0) throw AuroraException("Expected 0 arguments, got " + std::to_string(arguments) + ".");
+    // pulling may run script code that moves obj
+    auto iterator = of(obj);
+    AuroraObj element;
+    if (!iterator->next(element)) return AuroraObj();
+    return element;
+}
+
+AuroraObj AuroraIterator::map(const AuroraObj &iterable, AuroraObj fn) {
+    return make(std::make_shared<Map>(over(iterable), std::move(fn)));
+}
+
+AuroraObj AuroraIterator::filter(const AuroraObj &iterable, AuroraObj fn) {
+    return make(std::make_shared<Filter>(over(iterable), std::move(fn)));
+}
+
+AuroraObj AuroraIterator::take(const AuroraObj &iterable, size_t count) {
+    return make(std::make_shared<Take>(over(iterable), count));
+}
+
+AuroraObj AuroraIterator::lines() {
+    return make(std::make_shared<Lines>());
+}
+
+AuroraObj AuroraIterator::collect(const AuroraObj &iterable) {
+    auto source = over(iterable);
+    std::vector<AuroraObj> list;
+    AuroraObj element;
+    while (source->next(element)) list.push_back(std::move(element));
+    return AuroraObj(std::move(list));
+}
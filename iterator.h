@@ -0,0 +1,39 @@
+#ifndef AURORA_ITERATOR_H
+#define AURORA_ITERATOR_H
+
+#include "aurora_obj.h"
+
+// Lazy sequences, made by subclasses of AuroraIterator. An iterator value holds a shared pointer to
+// one: for loops and the adapters pull its elements one at a time, and calling it from a script
+// returns the next element, or null once it's exhausted. Copies of an iterator share its position.
+struct AuroraIterator {
+    virtual ~AuroraIterator() = default;
+
+    // the next element into out, false once there are none
+    virtual bool next(AuroraObj &out) = 0;
+
+    static AuroraObj make(std::shared_ptr<AuroraIterator> iterator);
+
+    // obj's iterator if it's one, else null
+    static std::shared_ptr<AuroraIterator> of(const AuroraObj &obj);
+
+    // an iterator over a list, the characters of a string, or obj itself if it's an iterator
+    static std::shared_ptr<AuroraIterator> over(const AuroraObj &obj);
+
+    // a script calling obj, an iterator, with the given number of arguments
+    static AuroraObj call(const AuroraObj &obj, size_t arguments);
+
+    // adapters: fn is called as each element is pulled through them
+    static AuroraObj map(const AuroraObj &iterable, AuroraObj fn);
+
+    static AuroraObj filter(const AuroraObj &iterable, AuroraObj fn);
+
+    static AuroraObj take(const AuroraObj &iterable, size_t count);
+
+    // lines of stdin, read as they're pulled, see AuroraInput
+    static AuroraObj lines();
+
+    static AuroraObj collect(const AuroraObj &iterable);
+};
+
+#endif //AURORA_ITERATOR_H
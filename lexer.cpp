@@ -82,7 +82,7 @@ Token Lexer::string() {
             escaped += value[i];
         }
     }
-    return {TokenType::STRING, value, value, line};
+    return {TokenType::STRING, escaped, escaped, line};
 }
 
 Token Lexer::number() {
@@ -142,6 +142,8 @@ Token Lexer::nextToken()  {
             else return {TokenType::ASSIGN, "=", nullptr, line};
         case ':':
             return {TokenType::COLON, ":", nullptr, line};
+        case '.':
+            return {TokenType::DOT, ".", nullptr, line};
         case '\n':
             line++;
             return {TokenType::NEWLINE, "\n", nullptr, line};
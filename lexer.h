@@ -17,7 +17,7 @@ enum class TokenType {
     IDENTIFIER, STRING, NUMBER, TRUE, FALSE, NIL,
     IF, ELSE, WHILE, FOR, FN, RETURN, BREAK, CONTINUE,
     NEWLINE, END, ASSIGN, PLUS_ASSIGN, MINUS_ASSIGN, STAR_ASSIGN, SLASH_ASSIGN, MODULO_ASSIGN,
-    ARROW, EOF_,
+    ARROW, DOT, STRUCT, EOF_,
 };
 
 struct Token {
@@ -51,6 +51,7 @@ private:
             {"while",    TokenType::WHILE},
             {"for",      TokenType::FOR},
             {"fn",       TokenType::FN},
+            {"struct",   TokenType::STRUCT},
             {"return",   TokenType::RETURN},
             {"break",    TokenType::BREAK},
             {"continue", TokenType::CONTINUE},
@@ -1,7 +1,60 @@
 #include "context.h"
+#include "scheduler.h"
 #include "std_lib.h"
+#include <fstream>
+#include <sstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-int main() {
+// runs the scripts at paths side by side on a scheduler, each with its own copy of the globals
+static int runScripts(const std::vector<std::string> &paths, size_t workers) {
+    // read them all first, a script starts running as soon as it's submitted
+    std::vector<std::string> sources;
+    for (const auto &path: paths) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cerr << "Couldn't open " << path << ".\n";
+            return 1;
+        }
+        std::stringstream source;
+        source << in.rdbuf();
+        sources.push_back(source.str());
+    }
+    AuroraScheduler scheduler(workers);
+    std::vector<size_t> ids;
+    for (auto &source: sources) ids.push_back(scheduler.submit(std::move(source), globals));
+    scheduler.wait();
+    int status = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+        std::string error = scheduler.error(ids[i]);
+        // parked once every script has settled, so nothing is left to send to its channels
+        if (error.empty() && !scheduler.done(ids[i])) error = "Every task is blocked, waiting on a channel or another task.";
+        if (error.empty()) continue;
+        std::cerr << paths[i] << ": " << error << "\n";
+        status = 1;
+    }
+    return status;
+}
+
+int main(int argc, char **argv) {
+#ifdef __GLIBC__
+    // scripts free and reallocate large lists constantly, don't hand the memory back to the OS each time
+    mallopt(M_MMAP_THRESHOLD, 32 << 20);
+    mallopt(M_TRIM_THRESHOLD, 64 << 20);
+#endif
+    // --scripts=<file>,<file>,... runs those files on a scheduler instead of the demo, --workers=N
+    // sets its thread count; the other flags only apply to the demo
+    std::vector<std::string> scripts;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--scripts=", 0) == 0) {
+            std::stringstream list(arg.substr(10));
+            for (std::string path; std::getline(list, path, ',');) if (!path.empty()) scripts.push_back(path);
+        } else if (arg.rfind("--workers=", 0) == 0) workers = std::max(1ul, std::stoul(arg.substr(10)));
+    }
+    if (!scripts.empty()) return runScripts(scripts, workers);
     AuroraContext context(R"(
         fn is_prime n
             if n < 2 return false
@@ -19,6 +72,109 @@ int main() {
             end
         end
         )", globals);
-    context.run();
+    // AURORA_PROFILE=<file> samples the run, writing collapsed stacks to file and a report to stderr
+    AuroraProfiler profiler;
+    const char *profile = std::getenv("AURORA_PROFILE");
+    if (profile) {
+        context.profiler = &profiler;
+        profiler.start();
+    }
+    // --stats reports phase timings, code size and allocations to stderr, --stats=<file> as JSON
+    AuroraStats stats;
+    std::string statsPath;
+    bool wantStats = false;
+    // --perf counts hardware events around execution and reports them per function and opcode
+    AuroraPerfCounters perfCounters;
+    bool wantPerf = false;
+    // --trace=<file> writes a Chrome trace-event timeline, --trace-depth and --trace-sample bound it
+    std::unique_ptr<AuroraTracer> tracer;
+    std::string tracePath;
+    // --heap-limit=<bytes> bounds live heap, --heap-report lists live bytes by allocation site,
+    // --heap-snapshot=<file> writes the object graph when the limit is hit, or at exit
+    bool heapReport = false;
+    // --output=<file> sends the script's output to file, --flush=line|block|exit picks when it's written
+    std::string outputPath;
+    // --max-instructions=N and --timeout=<ms> stop the script once spent, --time-slice=<ms> instead
+    // suspends it every slice and resumes it, as a host time-slicing scripts would
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--max-instructions=", 0) == 0) context.instructionBudget = std::stoull(arg.substr(19));
+        else if (arg.rfind("--timeout=", 0) == 0) context.timeBudget = std::chrono::milliseconds(std::stoll(arg.substr(10)));
+        else if (arg.rfind("--time-slice=", 0) == 0) {
+            context.timeBudget = std::chrono::milliseconds(std::stoll(arg.substr(13)));
+            context.yieldOnBudget = true;
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--trace=", 0) == 0) {
+            tracePath = arg.substr(8);
+            if (!tracer) tracer = std::make_unique<AuroraTracer>();
+        } else if (arg.rfind("--trace-depth=", 0) == 0) {
+            if (!tracer) tracer = std::make_unique<AuroraTracer>();
+            tracer->maxDepth = std::stoul(arg.substr(14));
+        } else if (arg.rfind("--trace-sample=", 0) == 0) {
+            if (!tracer) tracer = std::make_unique<AuroraTracer>();
+            tracer->sampleEvery = std::max(1ul, std::stoul(arg.substr(15)));
+        } else if (arg.rfind("--heap-limit=", 0) == 0) {
+            context.heapLimit = std::stoll(arg.substr(13));
+        } else if (arg.rfind("--heap-snapshot=", 0) == 0) {
+            context.heapSnapshotPath = arg.substr(16);
+        } else if (arg == "--heap-report") heapReport = true;
+        else if (arg == "--perf") wantPerf = true;
+        else if (arg == "--stats") wantStats = true;
+        else if (arg.rfind("--stats=", 0) == 0) {
+            wantStats = true;
+            statsPath = arg.substr(8);
+        } else if (arg.rfind("--output=", 0) == 0) outputPath = arg.substr(9);
+        else if (arg == "--flush=line") context.output.policy = AuroraOutput::Flush::LINE;
+        else if (arg == "--flush=block") context.output.policy = AuroraOutput::Flush::BLOCK;
+        else if (arg == "--flush=exit") context.output.policy = AuroraOutput::Flush::EXIT;
+    }
+    if (wantStats) context.stats = &stats;
+    if (wantPerf) {
+        if (perfCounters.open()) context.perfCounters = &perfCounters;
+        else std::cerr << "perf_event_open is not available, running without counters\n";
+    }
+    if (!tracePath.empty()) context.tracer = tracer.get();
+    if (heapReport || !context.heapSnapshotPath.empty()) AuroraAllocations::enabled++;
+    AuroraAllocations::trackSites = heapReport;
+    try {
+        if (!outputPath.empty()) context.output.toFile(outputPath);
+        context.run();
+        while (context.suspended()) context.resume();
+        // nothing else here can send, so tasks still waiting never will be woken
+        if (context.blocked()) throw AuroraException("Every task is blocked, waiting on a channel or another task.");
+    } catch (const AuroraHeapLimitException &e) {
+        std::cerr << e.what() << "\n";
+        if (heapReport) AuroraHeap::writeReport(std::cerr, context.heap);
+        return 1;
+    } catch (const AuroraException &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    if (!context.heapSnapshotPath.empty()) {
+        std::ofstream out(context.heapSnapshotPath);
+        context.writeHeapSnapshot(out);
+    }
+    if (heapReport) AuroraHeap::writeReport(std::cerr, context.heap);
+    if (context.tracer) {
+        std::ofstream out(tracePath);
+        tracer->write(out);
+    }
+    if (context.perfCounters) perfCounters.write(std::cerr);
+    if (wantStats) {
+        if (statsPath.empty()) stats.write(std::cerr);
+        else {
+            std::ofstream out(statsPath);
+            stats.writeJson(out);
+        }
+    }
+    if (profile) {
+        profiler.stop();
+        std::ofstream out(profile);
+        profiler.writeCollapsed(out);
+        profiler.writeReport(std::cerr);
+    }
     return 0;
 }
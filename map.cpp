@@ -0,0 +1,225 @@
+#include "map.h"
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    // bit i set where group[i] == tag, for the 16 control bytes of a group
+    uint32_t matches(const int8_t *group, int8_t tag) {
+#if defined(__x86_64__)
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+        return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag)));
+#else
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; i++) if (group[i] == tag) bits |= 1u << i;
+        return bits;
+#endif
+    }
+
+    uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    constexpr size_t groupSize = 16;
+
+    // a number key's identity: every NaN is one key and -0 is 0. Worked out on the bits, since
+    // release builds use fast math, which assumes there are no NaNs and folds away x + 0.0
+    uint64_t keyBits(double number) {
+        uint64_t bits;
+        std::memcpy(&bits, &number, sizeof bits);
+        constexpr uint64_t exponent = 0x7ff0000000000000ULL, mantissa = 0x000fffffffffffffULL;
+        if ((bits & exponent) == exponent && (bits & mantissa)) return exponent | 1ULL << 51;
+        if (bits << 1 == 0) return 0;
+        return bits;
+    }
+}
+
+AuroraMap *AuroraMap::of(const AuroraObj &obj) {
+    auto map = std::get_if<std::shared_ptr<AuroraMap>>(&obj.value);
+    return map ? map->get() : nullptr;
+}
+
+AuroraMap &AuroraMap::from(const AuroraObj &obj) {
+    if (auto map = of(obj)) return *map;
+    throw AuroraException("Expected a map, got " + variantIndexToString(obj.value.index()) + ".");
+}
+
+AuroraMap::~AuroraMap() {
+    if (accounted && AuroraAllocations::counting()) AuroraAllocations::release(8, accountedAt, accounted);
+}
+
+AuroraObj AuroraMap::make() {
+    return AuroraObj(std::make_shared<AuroraMap>());
+}
+
+uint64_t AuroraMap::hash(const AuroraObj &key) {
+    switch (key.value.index()) {
+        case 0:
+            return mix(keyBits(std::get<double>(key.value)));
+        case 1:
+            return mix(std::hash<std::string_view>()(key.asStringUnchecked()) ^ 1);
+        case 2:
+            return mix(key.asBoolUnchecked() ? 2 : 3);
+        default:
+            throw AuroraException("Map keys must be numbers, strings or booleans, got " +
+                                  variantIndexToString(key.value.index()) + ".");
+    }
+}
+
+bool AuroraMap::same(const AuroraObj &a, const AuroraObj &b) {
+    if (a.value.index() != b.value.index()) return false;
+    switch (a.value.index()) {
+        case 0:
+            return keyBits(std::get<double>(a.value)) == keyBits(std::get<double>(b.value));
+        case 1:
+            return a.asStringUnchecked() == b.asStringUnchecked();
+        default:
+            return a.asBoolUnchecked() == b.asBoolUnchecked();
+    }
+}
+
+long AuroraMap::find(const AuroraObj &key, uint64_t hash) const {
+    if (live == 0) return -1;
+    size_t mask = control.size() / groupSize - 1, group = (hash >> 7) & mask;
+    auto tag = (int8_t) (hash & 0x7f);
+    // groups are probed at triangular offsets, which reach every one of a power of two of them
+    for (size_t step = 1;; step++) {
+        const int8_t *bytes = control.data() + group * groupSize;
+        for (uint32_t bits = matches(bytes, tag); bits; bits &= bits - 1) {
+            size_t slot = group * groupSize + __builtin_ctz(bits);
+            auto &entry = entries[slots[slot]];
+            if (entry.hash == hash && same(entry.key, key)) return (long) slot;
+        }
+        // the key would have gone in the first empty slot on its way
+        if (matches(bytes, EMPTY)) return -1;
+        group = (group + step) & mask;
+    }
+}
+
+const AuroraObj *AuroraMap::get(const AuroraObj &key) const {
+    long slot = find(key, hash(key));
+    return slot < 0 ? nullptr : &entries[slots[slot]].value;
+}
+
+void AuroraMap::set(const AuroraObj &key, AuroraObj value) {
+    uint64_t keyHash = hash(key);
+    long found = find(key, keyHash);
+    if (found >= 0) {
+        entries[slots[found]].value = std::move(value);
+        return;
+    }
+    // at most 7/8 of the slots in use, so probes always end at an empty one
+    if ((used + 1) * 8 > control.size() * 7) rebuild(live + 1);
+    size_t mask = control.size() / groupSize - 1, group = (keyHash >> 7) & mask;
+    for (size_t step = 1;; step++) {
+        const int8_t *bytes = control.data() + group * groupSize;
+        uint32_t free = matches(bytes, EMPTY) | matches(bytes, ERASED);
+        if (free) {
+            size_t slot = group * groupSize + __builtin_ctz(free);
+            if (control[slot] == EMPTY) used++;
+            control[slot] = (int8_t) (keyHash & 0x7f);
+            slots[slot] = entries.size();
+            entries.push_back({key, std::move(value), keyHash});
+            live++;
+            account();
+            return;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+bool AuroraMap::erase(const AuroraObj &key) {
+    long slot = find(key, hash(key));
+    if (slot < 0) return false;
+    auto &entry = entries[slots[slot]];
+    entry.erased = true;
+    entry.key = AuroraObj();
+    entry.value = AuroraObj();
+    control[slot] = ERASED;
+    live--;
+    // mostly erased entries get compacted away
+    if (entries.size() > 2 * live + groupSize) rebuild(live);
+    return true;
+}
+
+void AuroraMap::rebuild(size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].erased) continue;
+        if (kept != i) entries[kept] = std::move(entries[i]);
+        kept++;
+    }
+    entries.resize(kept, {AuroraObj(), AuroraObj(), 0});
+    // under half full afterwards, so growing by doubling keeps inserts amortized O(1)
+    size_t capacity = groupSize;
+    while (capacity * 7 < count * 16) capacity *= 2;
+    control.assign(capacity, EMPTY);
+    slots.assign(capacity, 0);
+    used = live = entries.size();
+    size_t mask = capacity / groupSize - 1;
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t group = (entries[i].hash >> 7) & mask;
+        for (size_t step = 1;; step++) {
+            uint32_t free = matches(control.data() + group * groupSize, EMPTY);
+            if (free) {
+                size_t slot = group * groupSize + __builtin_ctz(free);
+                control[slot] = (int8_t) (entries[i].hash & 0x7f);
+                slots[slot] = i;
+                break;
+            }
+            group = (group + step) & mask;
+        }
+    }
+    account();
+}
+
+void AuroraMap::account() {
+    if (!AuroraAllocations::counting()) return;
+    size_t size = entries.capacity() * sizeof(Entry) + control.capacity() + slots.capacity() * sizeof(uint32_t);
+    if (size == accounted) return;
+    // released first, the entries may still be where they were, and that's how sites are keyed
+    if (accounted) AuroraAllocations::release(8, accountedAt, accounted);
+    accounted = 0;
+    AuroraAllocations::record(8, entries.data(), size);
+    accounted = size;
+    accountedAt = entries.data();
+}
+
+std::vector<AuroraObj> AuroraMap::keys() const {
+    std::vector<AuroraObj> keys;
+    keys.reserve(live);
+    for (auto &entry: entries) if (!entry.erased) keys.push_back(entry.key);
+    return keys;
+}
+
+std::vector<AuroraObj> AuroraMap::values() const {
+    std::vector<AuroraObj> values;
+    values.reserve(live);
+    for (auto &entry: entries) if (!entry.erased) values.push_back(entry.value);
+    return values;
+}
+
+void AuroraMap::appendTo(std::string &out) const {
+    if (live == 0) {
+        out += "{->}";
+        return;
+    }
+    out += '{';
+    bool first = true;
+    for (auto &entry: entries) {
+        if (entry.erased) continue;
+        if (!first) out += ", ";
+        first = false;
+        entry.key.appendTo(out);
+        out += " -> ";
+        entry.value.appendTo(out);
+    }
+    out += '}';
+}
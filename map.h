@@ -0,0 +1,83 @@
+#ifndef AURORA_MAP_H
+#define AURORA_MAP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "aurora_obj.h"
+
+// Hash maps from numbers, strings and booleans to values, written {key -> value, ...} in scripts,
+// {->} when empty. A map value holds a shared pointer to the map, so copies share it, and maps are
+// only equal to themselves.
+//
+// Entries are kept in insertion order, which is the order keys and for loops see them in, and are
+// found through an open-addressing index in the style of Swiss tables: a control byte per slot
+// holds 7 bits of the key's hash, and a probe tests a group of 16 of them at once, so most
+// lookups compare one key. Hashes are cached with the entries, so growing never rehashes a key.
+class AuroraMap {
+public:
+    AuroraMap() = default;
+
+    // copies would release the table's bytes twice, see account
+    AuroraMap(const AuroraMap &) = delete;
+
+    ~AuroraMap();
+
+    // obj's map if it's one, else null
+    static AuroraMap *of(const AuroraObj &obj);
+
+    // obj's map, throwing if it isn't one
+    static AuroraMap &from(const AuroraObj &obj);
+
+    static AuroraObj make();
+
+    [[nodiscard]] size_t size() const { return live; }
+
+    // the value stored under key, null if there's none
+    [[nodiscard]] const AuroraObj *get(const AuroraObj &key) const;
+
+    void set(const AuroraObj &key, AuroraObj value);
+
+    // false if key wasn't there
+    bool erase(const AuroraObj &key);
+
+    [[nodiscard]] std::vector<AuroraObj> keys() const;
+
+    [[nodiscard]] std::vector<AuroraObj> values() const;
+
+    void appendTo(std::string &out) const;
+
+private:
+    struct Entry {
+        AuroraObj key, value;
+        uint64_t hash;
+        bool erased = false;
+    };
+    std::vector<Entry> entries;
+    // per slot, EMPTY, ERASED or the low 7 bits of its entry's hash; slots come in groups of 16
+    std::vector<int8_t> control;
+    std::vector<uint32_t> slots; // index into entries, per full slot
+    size_t live = 0, used = 0;   // entries in the map, and slots that aren't EMPTY
+    // the table's bytes as last recorded in AuroraAllocations, and where
+    size_t accounted = 0;
+    const void *accountedAt = nullptr;
+
+    static constexpr int8_t EMPTY = -128, ERASED = -2;
+
+    static uint64_t hash(const AuroraObj &key);
+
+    static bool same(const AuroraObj &a, const AuroraObj &b);
+
+    // the slot holding key, or -1
+    [[nodiscard]] long find(const AuroraObj &key, uint64_t hash) const;
+
+    // resizes the index to fit count entries, dropping erased ones
+    void rebuild(size_t count);
+
+    // records the table's bytes again if they changed, while allocations are counted; copies of a
+    // map value share the table, so unlike lists it's the map that accounts for it
+    void account();
+};
+
+#endif //AURORA_MAP_H
@@ -0,0 +1,138 @@
+#include "opcode_stats.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <tuple>
+#include "aurora_obj.h"
+
+AuroraOpcodeStats opcodeStats;
+
+static int operands(InstructionType type) {
+    switch (type) {
+        case InstructionType::ADD:
+        case InstructionType::SUB:
+        case InstructionType::MUL:
+        case InstructionType::DIV:
+        case InstructionType::MOD:
+        case InstructionType::EQ:
+        case InstructionType::NEQ:
+        case InstructionType::LT:
+        case InstructionType::GT:
+        case InstructionType::LTE:
+        case InstructionType::GTE:
+        case InstructionType::IDX:
+        case InstructionType::ADD_NUM:
+        case InstructionType::ADD_STR:
+        case InstructionType::SUB_NUM:
+        case InstructionType::MUL_NUM:
+        case InstructionType::DIV_NUM:
+        case InstructionType::MOD_NUM:
+        case InstructionType::EQ_NUM:
+        case InstructionType::NEQ_NUM:
+        case InstructionType::LT_NUM:
+        case InstructionType::GT_NUM:
+        case InstructionType::LTE_NUM:
+        case InstructionType::GTE_NUM:
+        case InstructionType::IDX_LIST:
+        case InstructionType::IDX_STR:
+            return 2;
+        case InstructionType::NEG:
+        case InstructionType::NOT:
+        case InstructionType::NEG_NUM:
+        case InstructionType::NOT_BOOL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static std::string kindName(int kind) {
+    return kind == 8 ? "-" : variantIndexToString(kind);
+}
+
+void AuroraOpcodeStats::recordTypes(InstructionType type, const std::vector<AuroraObj> &stack) {
+    int count = operands(type);
+    if (count == 0 || stack.size() < count) return;
+    int a = stack[stack.size() - count].value.index();
+    int b = count == 2 ? (int)stack.back().value.index() : 8;
+    types[(int)type][a][b]++;
+}
+
+// nonzero pairs, most frequent first
+static std::vector<std::tuple<uint64_t, int, int>> sortedPairs(const uint64_t (&pairs)[instructionTypeCount][instructionTypeCount]) {
+    std::vector<std::tuple<uint64_t, int, int>> result;
+    for (int i = 0; i < instructionTypeCount; i++)
+        for (int j = 0; j < instructionTypeCount; j++)
+            if (pairs[i][j]) result.emplace_back(pairs[i][j], i, j);
+    std::sort(result.begin(), result.end(), std::greater<>());
+    return result;
+}
+
+void AuroraOpcodeStats::writeJson(std::ostream &out) const {
+    auto name = [](int type) { return "\"" + instructionTypeToString((InstructionType)type) + "\""; };
+    out << "{\n  \"opcodes\": [";
+    bool first = true;
+    for (int i = 0; i < instructionTypeCount; i++) {
+        if (!counts[i]) continue;
+        out << (first ? "\n" : ",\n") << "    {\"opcode\": " << name(i) << ", \"count\": " << counts[i]
+            << ", \"cycles\": " << cycles[i] << "}";
+        first = false;
+    }
+    out << "\n  ],\n  \"pairs\": [";
+    first = true;
+    for (auto [count, a, b]: sortedPairs(pairs)) {
+        out << (first ? "\n" : ",\n") << "    {\"first\": " << name(a) << ", \"second\": " << name(b)
+            << ", \"count\": " << count << "}";
+        first = false;
+    }
+    out << "\n  ],\n  \"types\": [";
+    first = true;
+    for (int i = 0; i < instructionTypeCount; i++) {
+        for (int a = 0; a < kinds; a++) {
+            for (int b = 0; b < kinds; b++) {
+                if (!types[i][a][b]) continue;
+                out << (first ? "\n" : ",\n") << "    {\"opcode\": " << name(i) << ", \"a\": \"" << kindName(a)
+                    << "\", \"b\": \"" << kindName(b) << "\", \"count\": " << types[i][a][b] << "}";
+                first = false;
+            }
+        }
+    }
+    out << "\n  ]\n}\n";
+}
+
+void AuroraOpcodeStats::writeCsv(std::ostream &out) const {
+    out << "kind,opcode,next,a,b,count,cycles\n";
+    for (int i = 0; i < instructionTypeCount; i++) {
+        if (counts[i]) out << "opcode," << instructionTypeToString((InstructionType)i) << ",,,," << counts[i] << ","
+                           << cycles[i] << "\n";
+    }
+    for (auto [count, a, b]: sortedPairs(pairs)) {
+        out << "pair," << instructionTypeToString((InstructionType)a) << ","
+            << instructionTypeToString((InstructionType)b) << ",,," << count << ",\n";
+    }
+    for (int i = 0; i < instructionTypeCount; i++) {
+        for (int a = 0; a < kinds; a++) {
+            for (int b = 0; b < kinds; b++) {
+                if (types[i][a][b]) out << "types," << instructionTypeToString((InstructionType)i) << ",,"
+                                        << kindName(a) << "," << kindName(b) << "," << types[i][a][b] << ",\n";
+            }
+        }
+    }
+}
+
+AuroraOpcodeStats::~AuroraOpcodeStats() {
+    const char *path = std::getenv("AURORA_OPCODE_STATS");
+    if (!path) {
+        writeJson(std::cerr);
+        return;
+    }
+    std::string file = path;
+    std::ofstream out(file);
+    if (!out) {
+        std::cerr << "Could not write opcode stats to " << file << "\n";
+        return;
+    }
+    if (file.size() >= 4 && file.compare(file.size() - 4, 4, ".csv") == 0) writeCsv(out);
+    else writeJson(out);
+}
@@ -0,0 +1,69 @@
+#ifndef AURORA_OPCODE_STATS_H
+#define AURORA_OPCODE_STATS_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "instruction.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+struct AuroraObj;
+
+// Per-opcode execution counts, opcode pair frequencies, cycles spent in each opcode and the
+// operand type mix at arithmetic and comparison sites. Only built with AURORA_OPCODE_STATS;
+// dumped at exit to $AURORA_OPCODE_STATS as CSV if it ends in .csv, JSON otherwise, or to stderr.
+class AuroraOpcodeStats {
+    static constexpr int kinds = 9; // AuroraObj variant indices, plus one for "no operand"
+
+    uint64_t counts[instructionTypeCount]{};
+    uint64_t cycles[instructionTypeCount]{};
+    uint64_t pairs[instructionTypeCount][instructionTypeCount]{};
+    uint64_t types[instructionTypeCount][kinds][kinds]{};
+    int previous = -1;
+    uint64_t last = 0;
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void recordTypes(InstructionType type, const std::vector<AuroraObj> &stack);
+
+public:
+    ~AuroraOpcodeStats();
+
+    // called on every dispatch, before jumping to the handler of type
+    void record(InstructionType type, const std::vector<AuroraObj> &stack) {
+        uint64_t time = now();
+        if (previous >= 0) {
+            cycles[previous] += time - last;
+            pairs[previous][(int)type]++;
+        }
+        counts[(int)type]++;
+        recordTypes(type, stack);
+        previous = (int)type;
+        last = now();
+    }
+
+    // the running opcode is done, e.g. when execute returns or throws
+    void stop() {
+        if (previous >= 0) cycles[previous] += now() - last;
+        previous = -1;
+    }
+
+    void writeJson(std::ostream &out) const;
+
+    void writeCsv(std::ostream &out) const;
+};
+
+extern AuroraOpcodeStats opcodeStats;
+
+#endif //AURORA_OPCODE_STATS_H
@@ -0,0 +1,89 @@
+#include "output.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+AuroraOutput::AuroraOutput() : policy(isatty(STDOUT_FILENO) ? Flush::LINE : Flush::BLOCK) {}
+
+AuroraOutput::~AuroraOutput() {
+    try {
+        flush();
+    } catch (const AuroraException &) {}
+    release();
+}
+
+void AuroraOutput::toDescriptor(int descriptor) {
+    flush();
+    release();
+    sink = Sink::DESCRIPTOR;
+    fd = descriptor;
+}
+
+void AuroraOutput::toFile(const std::string &path) {
+    int opened = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (opened < 0) throw AuroraException("Couldn't open " + path + ": " + std::strerror(errno) + ".");
+    toDescriptor(opened);
+    ownsFd = true;
+}
+
+void AuroraOutput::toMemory() {
+    flush();
+    release();
+    sink = Sink::MEMORY;
+}
+
+void AuroraOutput::discard() {
+    flush();
+    release();
+    sink = Sink::DISCARD;
+}
+
+void AuroraOutput::release() {
+    if (ownsFd) close(fd);
+    ownsFd = false;
+    fd = -1;
+}
+
+void AuroraOutput::overflow() {
+    if (sink == Sink::MEMORY) return;
+    if (sink == Sink::DISCARD) {
+        buffer.clear();
+        return;
+    }
+    size_t end = buffer.size();
+    if (policy != Flush::LINE) {
+        auto last = static_cast<const char *>(memrchr(buffer.data(), '\n', buffer.size()));
+        if (last) end = last - buffer.data() + 1;
+    }
+    writeOut(buffer.data(), end);
+    buffer.erase(0, end);
+}
+
+void AuroraOutput::flush() {
+    if (sink == Sink::MEMORY) return;
+    if (sink == Sink::DESCRIPTOR) writeOut(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void AuroraOutput::writeOut(const char *data, size_t size) {
+    if (size == 0) return;
+    // whatever the host printed through iostreams or stdio comes first
+    if (fd == STDOUT_FILENO) {
+        std::cout.flush();
+        std::fflush(stdout);
+    }
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            // drop the rest rather than failing again on every later write
+            buffer.clear();
+            throw AuroraException(std::string("Couldn't write output: ") + std::strerror(errno) + ".");
+        }
+        data += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef AURORA_OUTPUT_H
+#define AURORA_OUTPUT_H
+
+#include <string>
+#include <string_view>
+#include "aurora_obj.h"
+
+// A context's script output. print, write and writeln format values straight into a buffer, which
+// goes to the sink in large writes according to the flush policy.
+class AuroraOutput {
+public:
+    enum class Flush {
+        LINE,  // after every line, the default on a terminal
+        BLOCK, // whenever the buffer fills, and when run or resume return
+        EXIT   // whenever the buffer fills, and when the context goes away
+    };
+
+    Flush policy;
+
+    // bytes buffered before a write; a full buffer is written up to its last complete line, so
+    // scripts sharing a file descriptor don't split each other's lines
+    size_t capacity = 64 << 10;
+
+    AuroraOutput();
+
+    AuroraOutput(const AuroraOutput &) = delete;
+
+    AuroraOutput &operator=(const AuroraOutput &) = delete;
+
+    ~AuroraOutput();
+
+    // sinks, each flushing whatever the previous one has buffered first
+    void toDescriptor(int fd);
+
+    // opens path for writing, truncating it, and closes it once it's no longer the sink
+    void toFile(const std::string &path);
+
+    // keeps everything written, for hosts that embed scripts, see memory
+    void toMemory();
+
+    // formats but drops everything written
+    void discard();
+
+    // what's been written to the memory sink
+    [[nodiscard]] const std::string &memory() const { return buffer; }
+
+    void write(std::string_view text) {
+        buffer.append(text);
+        if (__builtin_expect(buffer.size() >= capacity, 0)) overflow();
+    }
+
+    void write(const AuroraObj &obj) {
+        obj.appendTo(buffer);
+        if (__builtin_expect(buffer.size() >= capacity, 0)) overflow();
+    }
+
+    // ends a line, flushing it under the line policy
+    void endLine() {
+        buffer.push_back('\n');
+        if (policy == Flush::LINE || __builtin_expect(buffer.size() >= capacity, 0)) overflow();
+    }
+
+    void flush();
+
+    // before reading stdin, so an interactive prompt shows
+    void beforeInput() {
+        if (policy == Flush::LINE) flush();
+    }
+
+    // run or resume is about to return
+    void finishRun() {
+        if (policy != Flush::EXIT) flush();
+    }
+
+private:
+    enum class Sink {
+        DESCRIPTOR, MEMORY, DISCARD
+    } sink = Sink::DESCRIPTOR;
+    int fd = 1;
+    bool ownsFd = false;
+    std::string buffer;
+
+    // the buffer is full, or a line ended under the line policy
+    void overflow();
+
+    void writeOut(const char *data, size_t size);
+
+    void release();
+};
+
+#endif //AURORA_OUTPUT_H
@@ -0,0 +1,218 @@
+#include "perf_counters.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include "profiler.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static constexpr int maxEvents = 8;
+static int eventFds[maxEvents];
+static volatile sig_atomic_t pendingOverflows[maxEvents];
+
+#ifdef __linux__
+static void overflow(int, siginfo_t *info, void *) {
+    for (int i = 0; i < maxEvents; i++) {
+        if (eventFds[i] == info->si_fd) {
+            pendingOverflows[i] = pendingOverflows[i] + 1;
+            auroraSampleRequested = 1;
+            return;
+        }
+    }
+}
+
+static int overflowSignal() { return SIGRTMIN + 2; }
+
+static constexpr uint64_t cacheMiss(uint64_t cache) {
+    return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+#endif
+
+AuroraPerfCounters::AuroraPerfCounters() {
+#ifdef __linux__
+    // task-clock is a software event, so there is always something to count even without a PMU
+    events = {
+            {"task-clock ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 1'000'000},
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 2'000'000},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 2'000'000},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 10'000},
+            {"L1D-read-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D), 10'000},
+            {"LLC-read-misses", PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL), 1'000},
+    };
+#endif
+    std::fill(std::begin(eventFds), std::end(eventFds), -1);
+}
+
+AuroraPerfCounters::~AuroraPerfCounters() {
+    stop();
+#ifdef __linux__
+    for (auto &event: events) {
+        if (event.fd >= 0) close(event.fd);
+    }
+#endif
+    std::fill(std::begin(eventFds), std::end(eventFds), -1);
+}
+
+bool AuroraPerfCounters::open() {
+#ifdef __linux__
+    struct sigaction action{};
+    action.sa_sigaction = overflow;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(overflowSignal(), &action, nullptr);
+    bool any = false;
+    for (size_t i = 0; i < events.size(); i++) {
+        auto &event = events[i];
+        perf_event_attr attr{};
+        attr.size = sizeof attr;
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.sample_period = event.period;
+        attr.wakeup_events = 1;
+        attr.disabled = 1;
+        // user space only, which is all an unprivileged process may count by default
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        event.fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (event.fd < 0) {
+            event.error = std::strerror(errno);
+            continue;
+        }
+        f_owner_ex owner{F_OWNER_TID, (pid_t) syscall(SYS_gettid)};
+        fcntl(event.fd, F_SETFL, O_ASYNC | O_NONBLOCK);
+        fcntl(event.fd, F_SETSIG, overflowSignal());
+        fcntl(event.fd, F_SETOWN_EX, &owner);
+        eventFds[i] = event.fd;
+        any = true;
+    }
+    return any;
+#else
+    return false;
+#endif
+}
+
+void AuroraPerfCounters::start() {
+#ifdef __linux__
+    if (running) return;
+    for (int i = 0; i < maxEvents; i++) pendingOverflows[i] = 0;
+    for (auto &event: events) {
+        if (event.fd < 0) continue;
+        ioctl(event.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(event.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    running = true;
+#endif
+}
+
+void AuroraPerfCounters::stop() {
+#ifdef __linux__
+    if (!running) return;
+    for (auto &event: events) {
+        if (event.fd < 0) continue;
+        ioctl(event.fd, PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t values[3]; // value, time enabled, time running
+        if (read(event.fd, values, sizeof values) != sizeof values) continue;
+        event.scale = values[2] ? (double) values[1] / values[2] : 0;
+        event.total += values[0] * event.scale;
+    }
+    running = false;
+#endif
+}
+
+bool AuroraPerfCounters::pending() const {
+    for (size_t i = 0; i < events.size() && i < maxEvents; i++) {
+        if (pendingOverflows[i]) return true;
+    }
+    return false;
+}
+
+void AuroraPerfCounters::attribute(const std::string &function, InstructionType opcode) {
+    for (size_t i = 0; i < events.size() && i < maxEvents; i++) {
+        int overflows = pendingOverflows[i];
+        if (!overflows) continue;
+        pendingOverflows[i] = pendingOverflows[i] - overflows;
+        events[i].functions[function] += overflows;
+        events[i].opcodes[(int) opcode] += overflows;
+    }
+}
+
+void AuroraPerfCounters::write(std::ostream &out) const {
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(0);
+    out << "event                          total  multiplexed\n";
+    std::vector<const Event *> open;
+    for (const auto &event: events) {
+        out << "  " << std::left << std::setw(18) << event.name << std::right;
+        if (event.fd < 0) {
+            out << "  unavailable: " << event.error << "\n";
+            continue;
+        }
+        out << std::setw(16) << event.total << "  x" << std::setprecision(2) << event.scale << std::setprecision(0)
+            << "\n";
+        open.push_back(&event);
+    }
+    if (open.empty()) {
+        out.flags(flags);
+        return;
+    }
+    // overflows times the period times the multiplexing scale estimates the events in each bucket
+    auto estimate = [](const Event *event, uint64_t overflows) {
+        return overflows * event->period * event->scale;
+    };
+    auto table = [&](const std::string &title, const std::vector<std::string> &rows,
+                     const std::function<uint64_t(const Event *, const std::string &)> &overflows) {
+        out << std::left << std::setw(24) << title << std::right;
+        for (const auto *event: open) out << std::setw(18) << event->name;
+        out << "\n";
+        for (const auto &row: rows) {
+            out << "  " << std::left << std::setw(22) << row << std::right;
+            for (const auto *event: open) out << std::setw(18) << estimate(event, overflows(event, row));
+            out << "\n";
+        }
+    };
+
+    std::unordered_map<std::string, uint64_t> firstByFunction = open[0]->functions;
+    std::vector<std::string> functions;
+    for (const auto *event: open) {
+        for (const auto &[name, count]: event->functions) {
+            if (std::find(functions.begin(), functions.end(), name) == functions.end()) functions.push_back(name);
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [&](const auto &a, const auto &b) {
+        return firstByFunction[a] > firstByFunction[b];
+    });
+    table("per function (sampled)", functions, [](const Event *event, const std::string &name) {
+        auto it = event->functions.find(name);
+        return it == event->functions.end() ? 0 : it->second;
+    });
+
+    std::vector<int> opcodes;
+    for (int i = 0; i < instructionTypeCount; i++) {
+        for (const auto *event: open) {
+            if (event->opcodes[i]) {
+                opcodes.push_back(i);
+                break;
+            }
+        }
+    }
+    std::sort(opcodes.begin(), opcodes.end(), [&](int a, int b) {
+        return open[0]->opcodes[a] > open[0]->opcodes[b];
+    });
+    std::vector<std::string> names;
+    for (int opcode: opcodes) names.push_back(instructionTypeToString((InstructionType) opcode));
+    table("per opcode (sampled)", names, [&](const Event *event, const std::string &name) {
+        int index = opcodes[std::find(names.begin(), names.end(), name) - names.begin()];
+        return event->opcodes[index];
+    });
+    out.flags(flags);
+}
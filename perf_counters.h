@@ -0,0 +1,53 @@
+#ifndef AURORA_PERF_COUNTERS_H
+#define AURORA_PERF_COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "instruction.h"
+
+// Hardware counters from perf_event_open around script execution. Every event is opened on its
+// own, so the kernel multiplexes them when there are more events than counter slots, and totals
+// are scaled by time enabled over time running. Each event also signals every period events;
+// the dispatch loop attributes those overflows to the function and opcode that was executing.
+class AuroraPerfCounters {
+    struct Event {
+        std::string name;
+        uint32_t type;
+        uint64_t config;
+        uint64_t period;
+        int fd = -1;
+        std::string error{}; // why it couldn't be opened
+        double total = 0;
+        double scale = 1; // enabled / running, above 1 when multiplexed
+        std::unordered_map<std::string, uint64_t> functions{}; // overflows
+        uint64_t opcodes[instructionTypeCount]{};
+    };
+
+    std::vector<Event> events;
+    bool running = false;
+
+public:
+    AuroraPerfCounters();
+
+    ~AuroraPerfCounters();
+
+    // opens what the kernel and hardware allow, false if nothing could be opened
+    bool open();
+
+    void start();
+
+    void stop();
+
+    // whether any event has overflowed since the last attribute
+    [[nodiscard]] bool pending() const;
+
+    // charges pending overflows to function and opcode
+    void attribute(const std::string &function, InstructionType opcode);
+
+    void write(std::ostream &out) const;
+};
+
+#endif //AURORA_PERF_COUNTERS_H
@@ -0,0 +1,81 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <unordered_set>
+#include <sys/time.h>
+#include "aurora_exception.h"
+
+volatile sig_atomic_t auroraSampleRequested = 0;
+static volatile sig_atomic_t ticks = 0;
+
+static void requestSample(int) {
+    ticks = 1;
+    auroraSampleRequested = 1;
+}
+
+bool AuroraProfiler::consumeTick() {
+    if (!ticks) return false;
+    ticks = 0;
+    return true;
+}
+
+void AuroraProfiler::start() {
+    if (running) return;
+    struct sigaction action{};
+    action.sa_handler = requestSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previousAction) != 0) throw AuroraException("Could not install profiler.");
+    itimerval timer{{0, interval}, {0, interval}};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    running = true;
+}
+
+void AuroraProfiler::stop() {
+    if (!running) return;
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previousAction, nullptr);
+    ticks = 0;
+    running = false;
+}
+
+void AuroraProfiler::record(const std::vector<std::pair<const std::string *, int>> &stack) {
+    if (stack.empty()) return;
+    samples++;
+    std::string collapsed;
+    std::unordered_set<const std::string *> seen;
+    for (const auto &[function, line]: stack) {
+        if (!collapsed.empty()) collapsed += ';';
+        collapsed += *function + ":" + std::to_string(line);
+        // recursive functions count once towards total
+        if (seen.insert(function).second) total[*function]++;
+    }
+    stacks[collapsed]++;
+    self[*stack.back().first]++;
+}
+
+void AuroraProfiler::writeCollapsed(std::ostream &out) const {
+    for (const auto &[stack, count]: stacks) out << stack << " " << count << "\n";
+}
+
+void AuroraProfiler::writeReport(std::ostream &out) const {
+    std::vector<std::pair<std::string, uint64_t>> functions(total.begin(), total.end());
+    auto selfOf = [&](const std::string &name) {
+        auto it = self.find(name);
+        return it == self.end() ? 0 : it->second;
+    };
+    std::sort(functions.begin(), functions.end(), [&](const auto &a, const auto &b) {
+        return std::make_pair(selfOf(a.first), a.second) > std::make_pair(selfOf(b.first), b.second);
+    });
+    auto ms = [&](uint64_t count) { return count * interval / 1000.0; };
+    auto percent = [&](uint64_t count) { return samples ? 100.0 * count / samples : 0.0; };
+    out << samples << " samples, " << interval << "us apart\n";
+    out << std::fixed << std::setprecision(1);
+    out << std::setw(10) << "self ms" << std::setw(8) << "self%" << std::setw(10) << "total ms" << std::setw(8)
+        << "total%" << "  function\n";
+    for (const auto &[name, count]: functions) {
+        out << std::setw(10) << ms(selfOf(name)) << std::setw(8) << percent(selfOf(name)) << std::setw(10)
+            << ms(count) << std::setw(8) << percent(count) << "  " << name << "\n";
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef AURORA_PROFILER_H
+#define AURORA_PROFILER_H
+
+#include <csignal>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// set by signal handlers that want a sample, polled by the dispatch loop, which takes it at the
+// next instruction boundary where the frame stack is consistent
+extern volatile sig_atomic_t auroraSampleRequested;
+
+// Sampling profiler over the VM frame stack. A CPU-time timer fires every interval; each sample
+// is the chain of Aurora functions being executed, with the line each one is at.
+class AuroraProfiler {
+    int interval; // microseconds
+    uint64_t samples = 0;
+    std::unordered_map<std::string, uint64_t> stacks; // collapsed stack -> samples
+    std::unordered_map<std::string, uint64_t> self, total; // function -> samples
+    struct sigaction previousAction{};
+    bool running = false;
+
+public:
+    explicit AuroraProfiler(int interval = 1000) : interval(interval) {}
+
+    ~AuroraProfiler() { stop(); }
+
+    void start();
+
+    void stop();
+
+    // whether the timer has fired since the last sample
+    bool consumeTick();
+
+    // (function, line) for each active function, outermost first
+    void record(const std::vector<std::pair<const std::string *, int>> &stack);
+
+    // one "fn:line;fn:line count" line per distinct stack, the input format of flamegraph.pl
+    void writeCollapsed(std::ostream &out) const;
+
+    // self and total time per function, hottest first
+    void writeReport(std::ostream &out) const;
+};
+
+#endif //AURORA_PROFILER_H
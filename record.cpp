@@ -0,0 +1,155 @@
+#include "record.h"
+#include <deque>
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+static_assert(sizeof(AuroraRecord) % alignof(AuroraObj) == 0, "fields must be aligned after the header");
+
+namespace {
+    // declared types and field ids, shared by every context; only compiling touches them
+    struct Registry {
+        std::mutex mutex;
+        std::deque<AuroraStruct> types;
+        std::map<std::vector<std::string>, const AuroraStruct *> declared; // by name, then fields
+        std::unordered_map<std::string, int> ids;
+
+        int id(const std::string &name) {
+            return ids.emplace(name, (int) ids.size()).first->second;
+        }
+    };
+
+    // never destroyed, since records in globals can outlive a static destroyed at exit
+    Registry &registry() {
+        static auto &registry = *new Registry;
+        return registry;
+    }
+}
+
+AuroraRecordRef::AuroraRecordRef(const AuroraRecordRef &other) : record(other.record) {
+    // a moved-from reference holds nothing
+    if (record) record->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+AuroraRecordRef::~AuroraRecordRef() {
+    if (record && record->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) AuroraRecord::destroy(record);
+}
+
+struct AuroraRecord::Constructor {
+    const AuroraStruct *layout;
+
+    AuroraObj operator()(const std::vector<AuroraObj> &args) const {
+        if (args.size() > layout->fields.size())
+            throw AuroraException("Expected at most " + std::to_string(layout->fields.size()) + " arguments, got " +
+                                  std::to_string(args.size()) + ".");
+        return AuroraObj(AuroraRecordRef(make(layout, args)));
+    }
+};
+
+int AuroraRecord::fieldId(const std::string &name) {
+    auto &types = registry();
+    std::lock_guard<std::mutex> lock(types.mutex);
+    return types.id(name);
+}
+
+const AuroraStruct &AuroraRecord::declare(const std::string &name, const std::vector<std::string> &fields) {
+    auto &types = registry();
+    std::lock_guard<std::mutex> lock(types.mutex);
+    std::vector<std::string> key{name};
+    key.insert(key.end(), fields.begin(), fields.end());
+    if (auto found = types.declared.find(key); found != types.declared.end()) return *found->second;
+    AuroraStruct layout{name, fields, {}};
+    for (size_t i = 0; i < fields.size(); i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (fields[j] == fields[i]) throw AuroraException(name + " has two fields named " + fields[i] + ".");
+        }
+        layout.ids.push_back(types.id(fields[i]));
+    }
+    types.types.push_back(std::move(layout));
+    types.declared.emplace(std::move(key), &types.types.back());
+    return types.types.back();
+}
+
+AuroraObj AuroraRecord::constructor(const AuroraStruct &type) {
+    return AuroraObj(AuroraNativeFunction(Constructor{&type}));
+}
+
+AuroraRecord *AuroraRecord::of(const AuroraObj &obj) {
+    auto ref = std::get_if<AuroraRecordRef>(&obj.value);
+    return ref ? ref->get() : nullptr;
+}
+
+AuroraRecord &AuroraRecord::from(const AuroraObj &obj) {
+    if (auto record = of(obj)) return *record;
+    throw AuroraException("Expected a record, got " + variantIndexToString(obj.value.index()) + ".");
+}
+
+AuroraObj AuroraRecord::copy(const AuroraRecord &record) {
+    std::vector<AuroraObj> values(record.fields(), record.fields() + record.layout->fields.size());
+    return AuroraObj(AuroraRecordRef(make(record.layout, values)));
+}
+
+AuroraObj &AuroraRecord::find(int id) {
+    auto &ids = layout->ids;
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] == id) return fields()[i];
+    }
+    std::string name;
+    {
+        auto &types = registry();
+        std::lock_guard<std::mutex> lock(types.mutex);
+        for (auto &[field, fieldId]: types.ids) {
+            if (fieldId == id) name = field;
+        }
+    }
+    throw AuroraException(layout->name + " has no field " + name + ".");
+}
+
+AuroraRecord *AuroraRecord::make(const AuroraStruct *layout, const std::vector<AuroraObj> &values) {
+    size_t count = layout->fields.size(), size = sizeof(AuroraRecord) + count * sizeof(AuroraObj);
+    void *block = ::operator new(size);
+    bool counted = false;
+    size_t constructed = 0;
+    try {
+        // the block is shared by copies of the value, so it's counted here rather than per value
+        if (AuroraAllocations::counting()) {
+            AuroraAllocations::record(9, block, size);
+            counted = true;
+        }
+        auto record = new(block) AuroraRecord(layout);
+        for (; constructed < count; constructed++) {
+            if (constructed < values.size()) new(record->fields() + constructed) AuroraObj(values[constructed]);
+            else new(record->fields() + constructed) AuroraObj();
+        }
+        return record;
+    } catch (...) {
+        // copying a field can go over the heap limit too
+        auto fields = reinterpret_cast<AuroraObj *>(static_cast<AuroraRecord *>(block) + 1);
+        for (size_t i = 0; i < constructed; i++) fields[i].~AuroraObj();
+        if (counted) AuroraAllocations::release(9, block, size);
+        ::operator delete(block);
+        throw;
+    }
+}
+
+void AuroraRecord::destroy(AuroraRecord *record) {
+    size_t count = record->layout->fields.size();
+    for (size_t i = 0; i < count; i++) record->fields()[i].~AuroraObj();
+    record->~AuroraRecord();
+    if (AuroraAllocations::counting())
+        AuroraAllocations::release(9, record, sizeof(AuroraRecord) + count * sizeof(AuroraObj));
+    ::operator delete(record);
+}
+
+void AuroraRecord::appendTo(std::string &out) const {
+    out += layout->name;
+    out += '(';
+    for (size_t i = 0; i < layout->fields.size(); i++) {
+        if (i) out += ", ";
+        out += layout->fields[i];
+        out += ": ";
+        fields()[i].appendTo(out);
+    }
+    out += ')';
+}
@@ -0,0 +1,78 @@
+#ifndef AURORA_RECORD_H
+#define AURORA_RECORD_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "aurora_obj.h"
+
+// A type declared with struct Name field, field, ...: its name and its fields, in order. Types
+// are never freed, not even at exit, so records can point at theirs without counting references;
+// declaring the same name and fields again gives the same type, so recompiling doesn't add any.
+struct AuroraStruct {
+    std::string name;
+    std::vector<std::string> fields;
+    std::vector<int> ids; // the fields' ids, see AuroraRecord::fieldId
+};
+
+// Instances of declared structs. A declaration binds the struct's name to a constructor, which
+// takes up to one value per field and leaves the rest null. A record value is an AuroraRecordRef,
+// so copies share the record, and records are only equal to themselves.
+//
+// A record is one block, a small header followed by its fields. The compiler turns obj.field into
+// the offset field has in the structs the script declared so far, and the field opcodes check that guess
+// with one comparison against the record's type, only searching its fields when it's wrong.
+class AuroraRecord {
+public:
+    // the id every field named name has, whichever struct it's in
+    static int fieldId(const std::string &name);
+
+    // declares a struct, or finds the one already declared with the same name and fields
+    static const AuroraStruct &declare(const std::string &name, const std::vector<std::string> &fields);
+
+    // a native function making records of type
+    static AuroraObj constructor(const AuroraStruct &type);
+
+    // obj's record if it's one, else null
+    static AuroraRecord *of(const AuroraObj &obj);
+
+    // obj's record, throwing if it isn't one
+    static AuroraRecord &from(const AuroraObj &obj);
+
+    // a new record of the same struct, with the same values in its fields
+    static AuroraObj copy(const AuroraRecord &record);
+
+    [[nodiscard]] const AuroraStruct &type() const { return *layout; }
+
+    // the field with the given id, looked for at offset first; throws if there's no such field
+    AuroraObj &field(int id, int offset) {
+        if ((size_t) offset < layout->ids.size() && layout->ids[offset] == id) return fields()[offset];
+        return find(id);
+    }
+
+    void appendTo(std::string &out) const;
+
+private:
+    std::atomic<uint32_t> refs{1};
+    const AuroraStruct *layout;
+
+    explicit AuroraRecord(const AuroraStruct *layout) : layout(layout) {}
+
+    // the fields follow the header in the same block
+    AuroraObj *fields() { return reinterpret_cast<AuroraObj *>(this + 1); }
+
+    [[nodiscard]] const AuroraObj *fields() const { return reinterpret_cast<const AuroraObj *>(this + 1); }
+
+    AuroraObj &find(int id);
+
+    static AuroraRecord *make(const AuroraStruct *layout, const std::vector<AuroraObj> &values);
+
+    static void destroy(AuroraRecord *record);
+
+    friend class AuroraRecordRef;
+
+    // the constructor's native function target, see record.cpp
+    struct Constructor;
+};
+
+#endif //AURORA_RECORD_H
@@ -0,0 +1,633 @@
+#include "regex.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+    struct Node {
+        enum class Kind {
+            BYTES, CAT, ALT, REPEAT, GROUP, BEGIN, END, EMPTY
+        } kind = Kind::EMPTY;
+        std::bitset<256> bytes;
+        std::vector<Node> children;
+        int min = 0, max = 0; // REPEAT, max -1 for no limit
+        int group = 0;
+
+        static Node of(Kind kind) {
+            Node node;
+            node.kind = kind;
+            return node;
+        }
+    };
+
+    constexpr int maxRepeat = 1000;
+    constexpr size_t maxStates = 100000;
+
+    // a compiled pattern value
+    struct Compiled {
+        std::shared_ptr<AuroraRegex> regex;
+
+        AuroraObj operator()(const std::vector<AuroraObj> &args) const {
+            if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+            guardType(args[0].value.index(), 1);
+            return AuroraObj(regex->search(args[0].asStringUnchecked()));
+        }
+    };
+}
+
+struct AuroraRegex::Compiler {
+    AuroraRegex &regex;
+    const std::string &pattern;
+    size_t position = 0;
+
+    [[noreturn]] void fail(const std::string &why) const {
+        throw AuroraException("Invalid regex '" + pattern + "': " + why + ".");
+    }
+
+    [[nodiscard]] bool done() const { return position >= pattern.size(); }
+
+    [[nodiscard]] char peek() const { return pattern[position]; }
+
+    bool eat(char c) {
+        if (done() || peek() != c) return false;
+        position++;
+        return true;
+    }
+
+    static std::bitset<256> single(unsigned char c) {
+        std::bitset<256> bytes;
+        bytes.set(c);
+        return bytes;
+    }
+
+    static std::bitset<256> range(int from, int to) {
+        std::bitset<256> bytes;
+        for (int c = from; c <= to; c++) bytes.set(c);
+        return bytes;
+    }
+
+    // the class an escape stands for, like \d, or the byte it escapes
+    std::bitset<256> escape() {
+        if (done()) fail("trailing backslash");
+        char c = pattern[position++];
+        std::bitset<256> bytes;
+        switch (c) {
+            case 'd':
+            case 'D':
+                bytes = range('0', '9');
+                break;
+            case 'w':
+            case 'W':
+                bytes = range('a', 'z') | range('A', 'Z') | range('0', '9') | single('_');
+                break;
+            case 's':
+            case 'S':
+                for (char space: std::string(" \t\n\r\f\v")) bytes.set((unsigned char) space);
+                break;
+            case 'n':
+                return single('\n');
+            case 't':
+                return single('\t');
+            case 'r':
+                return single('\r');
+            case 'f':
+                return single('\f');
+            case 'v':
+                return single('\v');
+            case 'b':
+            case 'B':
+                fail("word boundaries aren't supported");
+            default:
+                if (std::isalnum((unsigned char) c)) fail(std::string("unknown escape \\") + c);
+                return single(c);
+        }
+        return std::isupper((unsigned char) c) ? ~bytes : bytes;
+    }
+
+    Node characterClass() {
+        bool negated = eat('^');
+        std::bitset<256> bytes;
+        bool first = true;
+        while (!done() && (first || peek() != ']')) {
+            first = false;
+            std::bitset<256> item;
+            unsigned char from = pattern[position];
+            if (eat('\\')) item = escape();
+            else {
+                position++;
+                item = single(from);
+            }
+            // a range, unless the - is the last thing in the class
+            if (item.count() == 1 && position + 1 < pattern.size() && peek() == '-' && pattern[position + 1] != ']') {
+                position++;
+                unsigned char to = pattern[position++];
+                if (to == '\\') {
+                    auto escaped = escape();
+                    if (escaped.count() != 1) fail("invalid range");
+                    for (to = 0; !escaped.test(to); to++);
+                }
+                if (to < from) fail("invalid range");
+                item = range(from, to);
+            }
+            bytes |= item;
+        }
+        if (!eat(']')) fail("missing ]");
+        Node node = Node::of(Node::Kind::BYTES);
+        node.bytes = negated ? ~bytes : bytes;
+        return node;
+    }
+
+    int number() {
+        if (done() || !std::isdigit((unsigned char) peek())) fail("expected a number in {}");
+        int value = 0;
+        while (!done() && std::isdigit((unsigned char) peek())) {
+            value = value * 10 + (pattern[position++] - '0');
+            if (value > maxRepeat) fail("repeat count over " + std::to_string(maxRepeat));
+        }
+        return value;
+    }
+
+    Node atom() {
+        char c = pattern[position++];
+        switch (c) {
+            case '(': {
+                Node node = Node::of(Node::Kind::GROUP);
+                if (eat('?')) {
+                    if (!eat(':')) fail("only (?: groups are supported");
+                    node.kind = Node::Kind::CAT;
+                } else node.group = ++regex.groupCount;
+                node.children.push_back(alternation());
+                if (!eat(')')) fail("missing )");
+                return node;
+            }
+            case '[':
+                return characterClass();
+            case '.': {
+                Node node = Node::of(Node::Kind::BYTES);
+                node.bytes = ~single('\n');
+                return node;
+            }
+            case '^':
+                return Node::of(Node::Kind::BEGIN);
+            case '$':
+                return Node::of(Node::Kind::END);
+            case '\\': {
+                Node node = Node::of(Node::Kind::BYTES);
+                node.bytes = escape();
+                return node;
+            }
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                fail(std::string("nothing to repeat before ") + c);
+            default: {
+                Node node = Node::of(Node::Kind::BYTES);
+                node.bytes = single(c);
+                return node;
+            }
+        }
+    }
+
+    Node repetition() {
+        Node node = atom();
+        while (!done()) {
+            int min, max;
+            if (eat('*')) min = 0, max = -1;
+            else if (eat('+')) min = 1, max = -1;
+            else if (eat('?')) min = 0, max = 1;
+            else if (eat('{')) {
+                min = max = number();
+                if (eat(',')) max = !done() && peek() == '}' ? -1 : number();
+                if (!eat('}')) fail("missing }");
+                if (max != -1 && max < min) fail("invalid repeat count");
+            } else break;
+            // matches are longest, so there's nothing for a lazy quantifier to do
+            if (!done() && peek() == '?') fail("lazy quantifiers aren't supported");
+            Node repeat = Node::of(Node::Kind::REPEAT);
+            repeat.min = min;
+            repeat.max = max;
+            repeat.children.push_back(std::move(node));
+            node = std::move(repeat);
+        }
+        return node;
+    }
+
+    Node concatenation() {
+        Node node = Node::of(Node::Kind::CAT);
+        while (!done() && peek() != '|' && peek() != ')') node.children.push_back(repetition());
+        return node;
+    }
+
+    Node alternation() {
+        Node first = concatenation();
+        if (done() || peek() != '|') return first;
+        Node node = Node::of(Node::Kind::ALT);
+        node.children.push_back(std::move(first));
+        while (eat('|')) node.children.push_back(concatenation());
+        return node;
+    }
+
+    int add(State state) {
+        if (regex.nfa.size() >= maxStates) fail("too large");
+        regex.nfa.push_back(state);
+        return (int) regex.nfa.size() - 1;
+    }
+
+    int split(int preferred, int other) {
+        return add({State::Kind::SPLIT, preferred, other});
+    }
+
+    // the NFA for node, continuing to next once it's matched; built back to front
+    int build(const Node &node, int next) {
+        switch (node.kind) {
+            case Node::Kind::BYTES: {
+                auto found = std::find(regex.byteSets.begin(), regex.byteSets.end(), node.bytes);
+                int bytes = (int) (found - regex.byteSets.begin());
+                if (found == regex.byteSets.end()) regex.byteSets.push_back(node.bytes);
+                State state{State::Kind::BYTES, next};
+                state.bytes = bytes;
+                return add(state);
+            }
+            case Node::Kind::CAT:
+                for (size_t i = node.children.size(); i-- > 0;) next = build(node.children[i], next);
+                return next;
+            case Node::Kind::ALT: {
+                int alternatives = build(node.children.back(), next);
+                for (size_t i = node.children.size() - 1; i-- > 0;) alternatives = split(build(node.children[i], next), alternatives);
+                return alternatives;
+            }
+            case Node::Kind::REPEAT: {
+                auto &body = node.children[0];
+                int result = next;
+                if (node.max == -1) {
+                    int loop = split(-1, next);
+                    regex.nfa[loop].out = build(body, loop);
+                    result = loop;
+                } else {
+                    for (int i = node.min; i < node.max; i++) result = split(build(body, result), next);
+                }
+                for (int i = 0; i < node.min; i++) result = build(body, result);
+                return result;
+            }
+            case Node::Kind::GROUP: {
+                State close{State::Kind::SAVE, next};
+                close.slot = 2 * node.group - 1;
+                State open{State::Kind::SAVE, build(node.children[0], add(close))};
+                open.slot = 2 * node.group - 2;
+                return add(open);
+            }
+            case Node::Kind::BEGIN:
+                return add({State::Kind::BEGIN, next});
+            case Node::Kind::END:
+                return add({State::Kind::END, next});
+            case Node::Kind::EMPTY:
+                return next;
+        }
+        return next;
+    }
+};
+
+AuroraRegex::AuroraRegex(const std::string &pattern) : pattern(pattern) {
+    Compiler compiler{*this, pattern};
+    Node root = compiler.alternation();
+    if (!compiler.done()) compiler.fail("unmatched )");
+    int match = compiler.add({State::Kind::MATCH});
+    start = compiler.build(root, match);
+    marks.assign(nfa.size(), 0);
+    // a match away from the start of the text must begin with one of these, unless it can be empty
+    std::vector<int> initial;
+    close(start, false, initial);
+    firstBytesOnly = true;
+    for (int state: initial) {
+        if (nfa[state].kind == State::Kind::BYTES) firstBytes |= byteSets[nfa[state].bytes];
+        else firstBytesOnly = false;
+    }
+    if (firstBytesOnly && firstBytes.count() == 1) for (firstByte = 0; !firstBytes.test(firstByte); firstByte++);
+    // DFA states don't know where they are, so a $ ahead of a ^ is left to this
+    matchesEmpty = captures("", 0, 0).has_value();
+    reset(searcher);
+    reset(matcher);
+}
+
+std::shared_ptr<AuroraRegex> AuroraRegex::of(const AuroraObj &obj) {
+    if (obj.value.index() == 7) {
+        auto compiled = obj.asNativeFunctionUnchecked().target<Compiled>();
+        if (compiled) return compiled->regex;
+    }
+    if (obj.value.index() != 1) throw AuroraException("Expected regex or string, got " + variantIndexToString(obj.value.index()) + ".");
+    // scripts pass the same few literal patterns over and over
+    thread_local std::unordered_map<std::string, std::shared_ptr<AuroraRegex>> cache;
+    auto &pattern = obj.asStringUnchecked();
+    auto found = cache.find(pattern);
+    if (found != cache.end()) return found->second;
+    if (cache.size() >= 1024) cache.clear();
+    auto regex = std::make_shared<AuroraRegex>(pattern);
+    cache.emplace(pattern, regex);
+    return regex;
+}
+
+AuroraObj AuroraRegex::compile(const std::string &pattern) {
+    return AuroraObj(AuroraNativeFunction(Compiled{std::make_shared<AuroraRegex>(pattern)}));
+}
+
+void AuroraRegex::close(int state, bool atStart, std::vector<int> &out, bool atEnd) {
+    // a set of NFA states, as DFA states are made of, holds those that consume bytes or match; $
+    // stays in it unresolved until the text ends
+    if (++generation == 0) {
+        std::fill(marks.begin(), marks.end(), 0);
+        generation = 1;
+    }
+    std::vector<int> pending{state};
+    while (!pending.empty()) {
+        int at = pending.back();
+        pending.pop_back();
+        if (marks[at] == generation) continue;
+        marks[at] = generation;
+        auto &current = nfa[at];
+        switch (current.kind) {
+            case State::Kind::SPLIT:
+                pending.push_back(current.out1);
+                pending.push_back(current.out);
+                break;
+            case State::Kind::SAVE:
+                pending.push_back(current.out);
+                break;
+            case State::Kind::BEGIN:
+                if (atStart) pending.push_back(current.out);
+                break;
+            case State::Kind::END:
+                if (atEnd) pending.push_back(current.out);
+                else out.push_back(at);
+                break;
+            default:
+                out.push_back(at);
+        }
+    }
+}
+
+void AuroraRegex::reset(Dfa &dfa) {
+    dfa.next.clear();
+    dfa.sets.clear();
+    dfa.accepts.clear();
+    dfa.ids.clear();
+    intern(dfa, {});
+    std::vector<int> initial;
+    close(start, true, initial);
+    dfa.starts[0] = intern(dfa, initial);
+    initial.clear();
+    close(start, false, initial);
+    dfa.starts[1] = intern(dfa, initial);
+}
+
+int AuroraRegex::intern(Dfa &dfa, std::vector<int> set) {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    auto found = dfa.ids.find(set);
+    if (found != dfa.ids.end()) return found->second;
+    uint8_t accepts = 0;
+    for (int state: set) {
+        if (nfa[state].kind == State::Kind::MATCH) accepts = 3;
+        else if (nfa[state].kind == State::Kind::END && !(accepts & 2)) {
+            // past the $, what's left must match nothing more
+            std::vector<int> after;
+            close(nfa[state].out, false, after, true);
+            for (int rest: after) if (nfa[rest].kind == State::Kind::MATCH) accepts |= 2;
+        }
+    }
+    int id = (int) dfa.sets.size();
+    dfa.ids.emplace(set, id);
+    dfa.sets.push_back(std::move(set));
+    dfa.accepts.push_back(accepts);
+    dfa.next.resize(dfa.next.size() + 256, -1);
+    return id;
+}
+
+int AuroraRegex::startState(Dfa &dfa, bool atStart) {
+    return dfa.starts[atStart ? 0 : 1];
+}
+
+int AuroraRegex::step(Dfa &dfa, int state, unsigned char byte) {
+    int32_t known = dfa.next[(size_t) state * 256 + byte];
+    if (known != -1) return known < -1 ? ~known : known;
+    std::vector<int> reached;
+    for (int at: dfa.sets[state]) {
+        auto &current = nfa[at];
+        if (current.kind == State::Kind::BYTES && byteSets[current.bytes].test(byte)) close(current.out, false, reached);
+    }
+    // unanchored, a match may also start at the next byte
+    if (dfa.unanchored) close(start, false, reached);
+    if (dfa.sets.size() >= maxDfaStates) {
+        // pathological patterns get their DFA rebuilt from here rather than growing without bound
+        std::vector<int> current = dfa.sets[state];
+        reset(dfa);
+        state = intern(dfa, std::move(current));
+    }
+    int next = intern(dfa, std::move(reached));
+    // transitions into matching states are stored complemented, so scanning loops can tell them
+    // apart from the dead state and unknown transitions with one comparison
+    dfa.next[(size_t) state * 256 + byte] = accepting(dfa, next, false) ? ~next : next;
+    return next;
+}
+
+size_t AuroraRegex::earliestEnd(std::string_view text, size_t from) {
+    if (text.empty()) return matchesEmpty ? 0 : std::string_view::npos;
+    int state = startState(searcher, from == 0);
+    if (accepting(searcher, state, from == text.size())) return from;
+    auto bytes = reinterpret_cast<const unsigned char *>(text.data());
+    // with nothing matched so far and every match starting with one byte, memchr finds the next try
+    int idle = firstByte >= 0 ? searcher.starts[1] : -1;
+    for (size_t i = from; i < text.size(); i++) {
+        if (state == idle) {
+            auto found = static_cast<const unsigned char *>(std::memchr(bytes + i, firstByte, text.size() - i));
+            if (!found) return std::string_view::npos;
+            i = found - bytes;
+        }
+        // the common case, a known transition to a state that neither matches nor is dead
+        int32_t next = searcher.next[(size_t) state * 256 + bytes[i]];
+        if (next > 0 && i + 1 < text.size()) {
+            state = next;
+            continue;
+        }
+        state = step(searcher, state, bytes[i]);
+        idle = firstByte >= 0 ? searcher.starts[1] : -1;
+        if (state == 0) return std::string_view::npos;
+        if (accepting(searcher, state, i + 1 == text.size())) return i + 1;
+    }
+    return std::string_view::npos;
+}
+
+size_t AuroraRegex::longest(std::string_view text, size_t from) {
+    if (text.empty()) return matchesEmpty ? 0 : std::string_view::npos;
+    int state = startState(matcher, from == 0);
+    size_t end = accepting(matcher, state, from == text.size()) ? from : std::string_view::npos;
+    auto bytes = reinterpret_cast<const unsigned char *>(text.data());
+    for (size_t i = from; i < text.size(); i++) {
+        int32_t next = matcher.next[(size_t) state * 256 + bytes[i]];
+        if (next > 0 && i + 1 < text.size()) {
+            state = next;
+            continue;
+        }
+        state = step(matcher, state, bytes[i]);
+        if (state == 0) break;
+        if (accepting(matcher, state, i + 1 == text.size())) end = i + 1;
+    }
+    return end;
+}
+
+bool AuroraRegex::search(std::string_view text) {
+    return earliestEnd(text, 0) != std::string_view::npos;
+}
+
+bool AuroraRegex::find(std::string_view text, size_t from, size_t &matchStart, size_t &matchEnd) {
+    if (from > text.size()) return false;
+    size_t end = earliestEnd(text, from);
+    if (end == std::string_view::npos) return false;
+    // the leftmost match starts no later than the one that ends first
+    for (size_t at = from; at <= end; at++) {
+        if (at > 0 && firstBytesOnly && (at == text.size() || !firstBytes.test((unsigned char) text[at]))) continue;
+        size_t longestEnd = longest(text, at);
+        if (longestEnd == std::string_view::npos) continue;
+        matchStart = at;
+        matchEnd = longestEnd;
+        return true;
+    }
+    return false;
+}
+
+std::optional<std::vector<size_t>> AuroraRegex::captures(std::string_view text, size_t from, size_t to) {
+    // a Pike VM: every thread steps through the text together, in priority order, so the first to
+    // match at to is the one a backtracking matcher would have found
+    struct Thread {
+        int state;
+        std::vector<size_t> slots;
+    };
+    std::vector<Thread> current, next;
+    auto add = [&](auto &self, std::vector<Thread> &list, int state, std::vector<size_t> slots, size_t at) -> void {
+        if (marks[state] == generation) return;
+        marks[state] = generation;
+        auto &here = nfa[state];
+        switch (here.kind) {
+            case State::Kind::SPLIT:
+                self(self, list, here.out, slots, at);
+                self(self, list, here.out1, std::move(slots), at);
+                return;
+            case State::Kind::SAVE:
+                slots[here.slot] = at;
+                self(self, list, here.out, std::move(slots), at);
+                return;
+            case State::Kind::BEGIN:
+                if (at == 0) self(self, list, here.out, std::move(slots), at);
+                return;
+            case State::Kind::END:
+                if (at == text.size()) self(self, list, here.out, std::move(slots), at);
+                return;
+            default:
+                list.push_back({state, std::move(slots)});
+        }
+    };
+    auto nextGeneration = [&]() {
+        if (++generation == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            generation = 1;
+        }
+    };
+    nextGeneration();
+    add(add, current, start, std::vector<size_t>(2 * groupCount, std::string_view::npos), from);
+    for (size_t at = from;; at++) {
+        nextGeneration();
+        for (auto &thread: current) {
+            auto &state = nfa[thread.state];
+            if (state.kind == State::Kind::MATCH) {
+                // lower priority threads are cut off by the first to match
+                if (at == to) return std::move(thread.slots);
+                continue;
+            }
+            if (at < to && byteSets[state.bytes].test((unsigned char) text[at]))
+                add(add, next, state.out, thread.slots, at + 1);
+        }
+        if (at == to) break;
+        current.swap(next);
+        next.clear();
+    }
+    return std::nullopt;
+}
+
+std::optional<std::vector<AuroraObj>> AuroraRegex::groups(std::string_view text) {
+    size_t matchStart, matchEnd;
+    if (!find(text, 0, matchStart, matchEnd)) return std::nullopt;
+    std::vector<AuroraObj> groups{AuroraObj(std::string(text.substr(matchStart, matchEnd - matchStart)))};
+    auto slots = *captures(text, matchStart, matchEnd);
+    for (int i = 0; i < groupCount; i++) {
+        size_t from = slots[2 * i], to = slots[2 * i + 1];
+        if (from == std::string_view::npos || to == std::string_view::npos) groups.emplace_back();
+        else groups.emplace_back(std::string(text.substr(from, to - from)));
+    }
+    return groups;
+}
+
+std::vector<AuroraObj> AuroraRegex::findAll(std::string_view text) {
+    std::vector<AuroraObj> matches;
+    size_t matchStart, matchEnd;
+    for (size_t at = 0; find(text, at, matchStart, matchEnd);) {
+        matches.emplace_back(std::string(text.substr(matchStart, matchEnd - matchStart)));
+        // an empty match would be found again where it is
+        at = matchEnd > matchStart ? matchEnd : matchEnd + 1;
+    }
+    return matches;
+}
+
+std::string AuroraRegex::replace(std::string_view text, std::string_view replacement) {
+    bool substitutes = replacement.find('$') != std::string_view::npos;
+    std::string result;
+    size_t copied = 0, matchStart, matchEnd;
+    for (size_t at = 0; find(text, at, matchStart, matchEnd);) {
+        result.append(text.substr(copied, matchStart - copied));
+        if (!substitutes) result.append(replacement);
+        else {
+            std::vector<size_t> slots;
+            for (size_t i = 0; i < replacement.size(); i++) {
+                if (replacement[i] != '$' || i + 1 == replacement.size()) {
+                    result += replacement[i];
+                    continue;
+                }
+                char next = replacement[++i];
+                if (next == '$') result += '$';
+                else if (next == '0') result.append(text.substr(matchStart, matchEnd - matchStart));
+                else if (next >= '1' && next <= '9' && next - '0' <= groupCount) {
+                    if (slots.empty()) slots = *captures(text, matchStart, matchEnd);
+                    size_t from = slots[2 * (next - '1')], to = slots[2 * (next - '1') + 1];
+                    if (from != std::string_view::npos && to != std::string_view::npos)
+                        result.append(text.substr(from, to - from));
+                } else {
+                    result += '$';
+                    result += next;
+                }
+            }
+        }
+        copied = matchEnd;
+        if (matchEnd > matchStart) at = matchEnd;
+        else {
+            // keep the byte an empty match was in front of
+            if (matchEnd < text.size()) result += text[matchEnd];
+            copied = at = matchEnd + 1;
+        }
+    }
+    if (copied < text.size()) result.append(text.substr(copied));
+    return result;
+}
+
+std::vector<AuroraObj> AuroraRegex::split(std::string_view text) {
+    std::vector<AuroraObj> pieces;
+    size_t copied = 0, matchStart, matchEnd;
+    for (size_t at = 0; find(text, at, matchStart, matchEnd);) {
+        if (matchEnd == matchStart) {
+            at = matchEnd + 1;
+            continue;
+        }
+        pieces.emplace_back(std::string(text.substr(copied, matchStart - copied)));
+        copied = at = matchEnd;
+    }
+    pieces.emplace_back(std::string(text.substr(copied)));
+    return pieces;
+}
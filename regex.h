@@ -0,0 +1,112 @@
+#ifndef AURORA_REGEX_H
+#define AURORA_REGEX_H
+
+#include <bitset>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "aurora_obj.h"
+
+// Regular expressions over bytes. Patterns compile to an NFA, which a DFA is built from lazily as
+// text is scanned, one state per set of NFA states reached and one transition per byte seen, so
+// matching costs a table lookup per byte. Matches are leftmost-longest. Capture groups need more
+// than a DFA can track, so they're found by simulating the NFA, over the span the DFA matched.
+//
+// Supported: literals, ., [classes] with ranges and negation, \d \w \s and their negations,
+// escapes, ^ and $ (of the whole text), groups, (?:...), |, *, +, ?, {n}, {n,} and {n,m}.
+//
+// Compiled patterns build their DFA as they go, so one mustn't be used on two threads at once.
+class AuroraRegex {
+public:
+    // throws AuroraException for invalid or unsupported patterns
+    explicit AuroraRegex(const std::string &pattern);
+
+    const std::string pattern;
+
+    // obj compiled: a value from compile, or a pattern string, compiled once per thread and cached
+    static std::shared_ptr<AuroraRegex> of(const AuroraObj &obj);
+
+    // a compiled pattern value, which when called with a string tells whether it matches
+    static AuroraObj compile(const std::string &pattern);
+
+    // whether the pattern matches anywhere in text
+    bool search(std::string_view text);
+
+    // the leftmost-longest match starting at or after from
+    bool find(std::string_view text, size_t from, size_t &start, size_t &end);
+
+    // the first match and its groups, null for groups that took no part in it
+    std::optional<std::vector<AuroraObj>> groups(std::string_view text);
+
+    std::vector<AuroraObj> findAll(std::string_view text);
+
+    // replaces every match, $0 to $9 in replacement standing for the match and its groups, $$ for $
+    std::string replace(std::string_view text, std::string_view replacement);
+
+    // the pieces between matches; empty matches don't split
+    std::vector<AuroraObj> split(std::string_view text);
+
+private:
+    struct State {
+        enum class Kind : uint8_t {
+            BYTES, SPLIT, SAVE, BEGIN, END, MATCH
+        } kind;
+        int out = -1, out1 = -1;
+        int bytes = -1; // BYTES: index into byteSets
+        int slot = 0;   // SAVE: 2 * group - 2 for its start, one more for its end
+    };
+    std::vector<State> nfa;
+    std::vector<std::bitset<256>> byteSets;
+    int start = 0, groupCount = 0;
+    std::bitset<256> firstBytes; // bytes a match can start with, away from the start of the text
+    bool firstBytesOnly = false; // whether a match must start with one of them
+    int firstByte = -1;          // the one byte, if firstBytesOnly and there's just one
+    bool matchesEmpty = false;   // whether the empty text matches, where ^ and $ both hold
+
+    // a lazily built DFA; state 0 is dead
+    struct Dfa {
+        bool unanchored;
+        std::vector<int32_t> next{}; // 256 transitions per state, -1 until first taken, see step
+        std::vector<std::vector<int>> sets{};
+        std::vector<uint8_t> accepts{}; // bit 0: a match ends here, bit 1: one does if the text ends here
+        std::map<std::vector<int>, int> ids{};
+        int starts[2] = {-1, -1}; // at the start of the text, and anywhere else
+    };
+    Dfa searcher{true}, matcher{false};
+    std::vector<uint32_t> marks;
+    uint32_t generation = 0;
+
+    static constexpr size_t maxDfaStates = 4096;
+
+    // parses the pattern and builds the NFA, see regex.cpp
+    struct Compiler;
+
+    // the states reached from state without consuming a byte, ^ passing only atStart and $ only atEnd
+    void close(int state, bool atStart, std::vector<int> &out, bool atEnd = false);
+
+    int intern(Dfa &dfa, std::vector<int> set);
+
+    void reset(Dfa &dfa);
+
+    int startState(Dfa &dfa, bool atStart);
+
+    int step(Dfa &dfa, int state, unsigned char byte);
+
+    static bool accepting(const Dfa &dfa, int state, bool atEnd) {
+        return dfa.accepts[state] & (atEnd ? 2 : 1);
+    }
+
+    // earliest position a match ends at, scanning from from
+    size_t earliestEnd(std::string_view text, size_t from);
+
+    // end of the longest match starting at from, npos if none does
+    size_t longest(std::string_view text, size_t from);
+
+    // the group spans of the match from start to end, if there is one, preferring earlier alternatives and longer repeats
+    std::optional<std::vector<size_t>> captures(std::string_view text, size_t start, size_t end);
+};
+
+#endif //AURORA_REGEX_H
@@ -0,0 +1,135 @@
+#include "scheduler.h"
+
+AuroraScheduler::AuroraScheduler(size_t count) {
+    for (size_t i = 0; i < count; i++) workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < count; i++) workers[i]->thread = std::thread([this, i]() { work(i); });
+}
+
+AuroraScheduler::~AuroraScheduler() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto &worker: workers) worker->thread.join();
+}
+
+size_t AuroraScheduler::submit(std::string source, const std::unordered_map<std::string, AuroraObj> &globals) {
+    auto script = std::make_unique<Script>();
+    script->globals = globals;
+    script->context = std::make_unique<AuroraContext>(std::move(source), script->globals);
+    script->context->timeBudget = timeSlice;
+    script->context->yieldOnBudget = true;
+    script->context->heapLimit = 0; // see the class comment
+    Script *waking = script.get();
+    script->context->onWake = [this, waking]() {
+        {
+            std::lock_guard lock(mutex);
+            active++;
+        }
+        enqueue(waking, nextWorker++ % workers.size());
+    };
+    size_t id;
+    {
+        std::lock_guard lock(mutex);
+        id = scripts.size();
+        scripts.push_back(std::move(script));
+        active++;
+    }
+    enqueue(waking, nextWorker++ % workers.size());
+    return id;
+}
+
+void AuroraScheduler::wait() {
+    std::unique_lock lock(mutex);
+    settled.wait(lock, [this]() { return active == 0; });
+}
+
+std::string AuroraScheduler::error(size_t script) {
+    std::lock_guard lock(mutex);
+    return scripts.at(script)->error;
+}
+
+bool AuroraScheduler::done(size_t script) {
+    std::lock_guard lock(mutex);
+    return !scripts.at(script)->context;
+}
+
+void AuroraScheduler::enqueue(Script *script, size_t worker) {
+    {
+        std::lock_guard lock(workers[worker]->mutex);
+        workers[worker]->queue.push_back(script);
+    }
+    // under the scheduler's lock, so a worker about to sleep either sees the script or gets notified
+    std::lock_guard lock(mutex);
+    queued++;
+    changed.notify_one();
+}
+
+AuroraScheduler::Script *AuroraScheduler::take(size_t worker) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        auto &from = *workers[(worker + i) % workers.size()];
+        std::lock_guard lock(from.mutex);
+        if (from.queue.empty()) continue;
+        Script *script;
+        if (i == 0) {
+            script = from.queue.front();
+            from.queue.pop_front();
+        } else {
+            script = from.queue.back();
+            from.queue.pop_back();
+        }
+        queued--;
+        return script;
+    }
+    return nullptr;
+}
+
+void AuroraScheduler::work(size_t worker) {
+    for (;;) {
+        Script *script = take(worker);
+        if (!script) {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [this]() { return stopping || queued > 0; });
+            if (stopping) return;
+            continue;
+        }
+        auto &context = *script->context;
+        try {
+            if (!script->started) {
+                script->started = true;
+                context.run();
+            } else context.resume();
+        } catch (const AuroraException &e) {
+            finished(script, e.what());
+            continue;
+        }
+        if (context.suspended()) {
+            enqueue(script, worker);
+        } else if (context.blocked()) {
+            // once parked, a wakeup may hand the script to another worker at any moment
+            bool parked;
+            {
+                std::lock_guard lock(mutex);
+                parked = context.park();
+                if (parked && --active == 0) settled.notify_all();
+            }
+            if (!parked) enqueue(script, worker);
+        } else finished(script);
+    }
+}
+
+void AuroraScheduler::finished(Script *script, std::string error) {
+    // free the script's VM, but keep its error around; done reads context under the lock, so it's
+    // taken out under it and freed after, before wait can see the script as settled
+    std::unique_ptr<AuroraContext> context;
+    {
+        std::lock_guard lock(mutex);
+        context = std::move(script->context);
+        script->error = std::move(error);
+    }
+    context.reset();
+    script->globals.clear();
+    std::lock_guard lock(mutex);
+    if (--active == 0) settled.notify_all();
+}
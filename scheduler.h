@@ -0,0 +1,69 @@
+#ifndef AURORA_SCHEDULER_H
+#define AURORA_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include "context.h"
+
+// Runs many scripts over a fixed set of worker threads. Each script gets its own context and copy of
+// the globals, and runs a time slice at a time: suspended scripts go to the back of their worker's
+// queue, a worker with an empty queue steals from the others, and scripts whose tasks are all
+// blocked are parked, using no thread at all, until a send to one of their channels wakes them.
+// Scripts run here have no heap limit: a value sent to another script is freed on that script's
+// account, so the sender's would only ever grow.
+class AuroraScheduler {
+    struct Script {
+        std::unordered_map<std::string, AuroraObj> globals;
+        std::unique_ptr<AuroraContext> context;
+        bool started = false;
+        std::string error;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Script *> queue;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<Script>> scripts;
+    std::mutex mutex;
+    std::condition_variable changed, settled; // workers wait on the first, wait() on the second
+    size_t active = 0; // scripts queued or running, so not parked or finished
+    std::atomic<size_t> queued = 0, nextWorker = 0;
+    bool stopping = false;
+
+    void enqueue(Script *script, size_t worker);
+
+    // the front of worker's own queue, else the back of another's
+    Script *take(size_t worker);
+
+    void work(size_t worker);
+
+    void finished(Script *script, std::string error = "");
+
+public:
+    // slice each script runs before the next queued one gets the worker
+    std::chrono::nanoseconds timeSlice = std::chrono::milliseconds(2);
+
+    explicit AuroraScheduler(size_t workers = std::max(1u, std::thread::hardware_concurrency()));
+
+    ~AuroraScheduler();
+
+    // compiles and runs source on the workers, with globals copied for it alone; returns its id
+    size_t submit(std::string source, const std::unordered_map<std::string, AuroraObj> &globals);
+
+    // blocks until every script has finished or is parked waiting on a channel
+    void wait();
+
+    // why script stopped, empty if it finished cleanly or is still running
+    std::string error(size_t script);
+
+    // false while script is queued, running or parked; after wait(), false means blocked for good
+    bool done(size_t script);
+};
+
+#endif //AURORA_SCHEDULER_H
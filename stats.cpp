@@ -0,0 +1,50 @@
+#include "stats.h"
+#include <iomanip>
+
+static const int allocationKinds[] = {1, 3, 4, 5, 8, 9};
+
+void AuroraStats::countCode(const AuroraCodeUnit &unit) {
+    codeUnits++;
+    instructions += unit.instructions.size();
+    constants += unit.constants.size();
+    maxConstants = std::max<uint64_t>(maxConstants, unit.constants.size());
+    for (const auto &constant: unit.constants) {
+        if (constant.value.index() == 5) countCode(std::get<AuroraCodeUnit>(constant.value));
+        else if (constant.value.index() == 4) countCode(*std::get<AuroraFunction>(constant.value).code);
+    }
+}
+
+void AuroraStats::write(std::ostream &out) const {
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "phase            ms\n";
+    out << "  lex        " << std::setw(10) << lexMs << "\n";
+    out << "  compile    " << std::setw(10) << compileMs << "\n";
+    out << "  inference  " << std::setw(10) << inferenceMs << "\n";
+    out << "  execute    " << std::setw(10) << executeMs << "\n";
+    out << "tokens " << tokens << ", code units " << codeUnits << ", instructions " << instructions
+        << ", constants " << constants << " (max " << maxConstants << " in one unit)\n";
+    out << "execute calls " << executeCalls << ", native calls " << nativeCalls << "\n";
+    out << "allocations     count         bytes\n";
+    for (int kind: allocationKinds) {
+        out << "  " << std::left << std::setw(10) << variantIndexToString(kind) << std::right << std::setw(10)
+            << AuroraAllocations::counts[kind].load() << std::setw(14) << AuroraAllocations::bytes[kind].load() << "\n";
+    }
+    out.flags(flags);
+}
+
+void AuroraStats::writeJson(std::ostream &out) const {
+    out << "{\n  \"phases_ms\": {\"lex\": " << lexMs << ", \"compile\": " << compileMs << ", \"inference\": "
+        << inferenceMs << ", \"execute\": " << executeMs << "},\n";
+    out << "  \"tokens\": " << tokens << ",\n  \"code_units\": " << codeUnits << ",\n  \"instructions\": "
+        << instructions << ",\n  \"constants\": " << constants << ",\n  \"max_constants_per_unit\": "
+        << maxConstants << ",\n  \"execute_calls\": " << executeCalls << ",\n  \"native_calls\": " << nativeCalls
+        << ",\n  \"allocations\": {";
+    bool first = true;
+    for (int kind: allocationKinds) {
+        out << (first ? "\n" : ",\n") << "    \"" << variantIndexToString(kind) << "\": {\"count\": "
+            << AuroraAllocations::counts[kind].load() << ", \"bytes\": " << AuroraAllocations::bytes[kind].load() << "}";
+        first = false;
+    }
+    out << "\n  }\n}\n";
+}
@@ -0,0 +1,25 @@
+#ifndef AURORA_STATS_H
+#define AURORA_STATS_H
+
+#include <cstdint>
+#include <ostream>
+#include "aurora_obj.h"
+
+// Where AuroraContext::run spends its time, how big the compiled program is and what it
+// allocates. Filled in by run when AuroraContext::stats is set.
+struct AuroraStats {
+    // lexing happens on demand during compilation, so compileMs includes lexMs
+    double lexMs = 0, compileMs = 0, inferenceMs = 0, executeMs = 0;
+    uint64_t tokens = 0;
+    uint64_t codeUnits = 0, instructions = 0, constants = 0, maxConstants = 0;
+    uint64_t executeCalls = 0, nativeCalls = 0;
+
+    // counts unit and every code unit nested in its constants
+    void countCode(const AuroraCodeUnit &unit);
+
+    void write(std::ostream &out) const;
+
+    void writeJson(std::ostream &out) const;
+};
+
+#endif //AURORA_STATS_H
@@ -8,107 +8,150 @@
 #include <unordered_map>
 #include <iostream>
 #include "aurora_obj.h"
+#include "context.h"
+#include "input.h"
+#include "file.h"
+#include "string_kernels.h"
+#include "regex.h"
+#include "format.h"
+#include "map.h"
 
 #define AURORA_FN(name, body) { name, AuroraObj(AuroraNativeFunction([](const std::vector<AuroraObj>& args) body)) }
 
 std::unordered_map<std::string, AuroraObj> globals = {
+    // output, buffered by the running context, see AuroraOutput
     AURORA_FN("print", {
-        for (const auto &arg : args) {
-            std::cout << arg.string_representation();
-        }
-        std::cout << "\n";
+        auto &output = AuroraContext::running().output;
+        for (const auto &arg : args) output.write(arg);
+        output.endLine();
+        return AuroraObj();
+    }),
+    AURORA_FN("write", {
+        auto &output = AuroraContext::running().output;
+        for (const auto &arg : args) output.write(arg);
+        return AuroraObj();
+    }),
+    AURORA_FN("writeln", {
+        auto &output = AuroraContext::running().output;
+        for (const auto &arg : args) output.write(arg);
+        output.endLine();
+        return AuroraObj();
+    }),
+    AURORA_FN("flush", {
+        if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+        AuroraContext::running().output.flush();
         return AuroraObj();
     }),
     AURORA_FN("push_back", {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 3);
         guardType(args[1].value.index(), 0);
-        auto vec = std::get<std::vector<AuroraObj>>(args[0].value);
-        vec.push_back(args[1]);
-        return AuroraObj(std::move(vec));
+        auto list = std::get<AuroraList>(args[0].value);
+        list.push_back(args[1]);
+        return AuroraObj(std::move(list));
     }),
     AURORA_FN("pop_back", {
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 3);
-        auto list = std::get<std::vector<AuroraObj>>(args[0].value);
+        auto list = std::get<AuroraList>(args[0].value);
         if (list.empty()) throw AuroraException("Cannot pop from empty list.");
         list.pop_back();
         return AuroraObj(std::move(list));
     }),
     AURORA_FN("size", {
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        if (auto map = AuroraMap::of(args[0])) return AuroraObj((double) map->size());
         guardType(args[0].value.index(), 3);
-        return AuroraObj((double)std::get<std::vector<AuroraObj>>(args[0].value).size());
+        return AuroraObj((double) args[0].asListUnchecked().size());
     }),
     AURORA_FN("range", {
         if (args.empty() || args.size() > 3) throw AuroraException("Expected 1 to 3 arguments, got " + std::to_string(args.size()) + ".");
         for (const auto &arg : args) {
             guardType(arg.value.index(), 0);
         }
-        std::vector<AuroraObj> list;
+        std::vector<double> list;
         if (args.size() == 1) {
+            if (args[0].asDouble() > 0) list.reserve(std::ceil(args[0].asDouble()));
             for (int i = 0; i < args[0].asDouble(); i++) {
-                list.emplace_back((double)i);
+                list.push_back(i);
             }
         } else if (args.size() == 2) {
+            if (args[1].asDouble() > args[0].asDouble()) list.reserve(std::ceil(args[1].asDouble() - (int) args[0].asDouble()));
             for (int i = args[0].asDouble(); i < args[1].asDouble(); i++) {
-                list.emplace_back((double)i);
+                list.push_back(i);
             }
         } else {
             for (int i = args[0].asDouble(); i < args[1].asDouble(); i += args[2].asDouble()) {
-                list.emplace_back((double)i);
+                list.push_back(i);
             }
         }
-        return AuroraObj(std::move(list));
+        return AuroraObj(AuroraList(std::move(list)));
     }),
     // string parsing functions
     AURORA_FN("split", {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 1);
-        std::vector<AuroraObj> list;
-        std::string str = std::get<std::string>(args[0].value);
-        std::string delimiter = std::get<std::string>(args[1].value);
-        size_t pos;
-        std::string token;
-        while ((pos = str.find(delimiter)) != std::string::npos) {
-            token = str.substr(0, pos);
-            list.emplace_back(std::move(token));
-            str.erase(0, pos + delimiter.length());
-        }
-        list.emplace_back(std::move(str));
-        return AuroraObj(std::move(list));
+        auto &delimiter = args[1].asStringUnchecked();
+        if (delimiter.empty()) throw AuroraException("Can't split on an empty delimiter.");
+        return AuroraObj(AuroraStrings::split(args[0].asStringUnchecked(), delimiter));
     }),
     AURORA_FN("join", {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 3);
         guardType(args[1].value.index(), 1);
-        std::string str;
-        for (const auto &arg : std::get<std::vector<AuroraObj>>(args[0].value)) {
+        // a packed list holds numbers, which can't be joined
+        if (args[0].asListUnchecked().packed()) {
+            if (!args[0].asListUnchecked().empty()) guardType(0, 1);
+            return AuroraObj(std::string());
+        }
+        auto &list = args[0].asListUnchecked().values();
+        auto &separator = args[1].asStringUnchecked();
+        size_t size = list.empty() ? 0 : separator.size() * (list.size() - 1);
+        for (const auto &arg : list) {
             guardType(arg.value.index(), 1);
-            str += std::get<std::string>(arg.value);
+            size += arg.asStringUnchecked().size();
+        }
+        std::string str;
+        str.reserve(size);
+        for (size_t i = 0; i < list.size(); i++) {
+            if (i > 0) str += separator;
+            str += list[i].asStringUnchecked();
         }
         return AuroraObj(std::move(str));
     }),
+    AURORA_FN("format", {
+        if (args.empty()) throw AuroraException("Expected at least 1 argument, got 0.");
+        guardType(args[0].value.index(), 1);
+        return AuroraObj(AuroraFormat::fill(args[0].asStringUnchecked(), args, 1));
+    }),
     AURORA_FN("replace", {
         if (args.size() != 3) throw AuroraException("Expected 3 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 1);
         guardType(args[2].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
-        std::string from = std::get<std::string>(args[1].value);
-        std::string to = std::get<std::string>(args[2].value);
-        size_t start_pos = str.find(from);
+        std::string str = args[0].asStringUnchecked();
+        auto &from = args[1].asStringUnchecked();
+        size_t start_pos = AuroraStrings::find(str, from);
         if (start_pos == std::string::npos) return AuroraObj(std::move(str));
-        str.replace(start_pos, from.length(), to);
+        str.replace(start_pos, from.length(), args[2].asStringUnchecked());
         return AuroraObj(std::move(str));
     }),
+    AURORA_FN("replace_all", {
+        if (args.size() != 3) throw AuroraException("Expected 3 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        guardType(args[1].value.index(), 1);
+        guardType(args[2].value.index(), 1);
+        auto &from = args[1].asStringUnchecked();
+        if (from.empty()) throw AuroraException("Can't replace an empty string.");
+        return AuroraObj(AuroraStrings::replaceAll(args[0].asStringUnchecked(), from, args[2].asStringUnchecked()));
+    }),
     AURORA_FN("substr", {
         if (args.size() != 3) throw AuroraException("Expected 3 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 0);
         guardType(args[2].value.index(), 0);
-        std::string str = std::get<std::string>(args[0].value);
+        auto &str = args[0].asStringUnchecked();
         int start = args[1].asDouble();
         int end = args[2].asDouble();
         if (start < 0) start = str.length() + start;
@@ -120,68 +163,104 @@ std::unordered_map<std::string, AuroraObj> globals = {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
-        std::string substr = std::get<std::string>(args[1].value);
-        return AuroraObj((double)str.find(substr));
+        return AuroraObj((double) AuroraStrings::find(args[0].asStringUnchecked(), args[1].asStringUnchecked()));
     }),
     AURORA_FN("find_last", {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
-        std::string substr = std::get<std::string>(args[1].value);
-        return AuroraObj((double)str.rfind(substr));
+        return AuroraObj((double) args[0].asStringUnchecked().rfind(args[1].asStringUnchecked()));
     }),
     AURORA_FN("contains?", {
         if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
         guardType(args[1].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
-        std::string substr = std::get<std::string>(args[1].value);
-        return AuroraObj(str.find(substr) != std::string::npos);
+        auto found = AuroraStrings::find(args[0].asStringUnchecked(), args[1].asStringUnchecked());
+        return AuroraObj(found != AuroraStrings::npos);
+    }),
+    AURORA_FN("count", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        guardType(args[1].value.index(), 1);
+        auto &pattern = args[1].asStringUnchecked();
+        if (pattern.empty()) throw AuroraException("Can't count an empty string.");
+        return AuroraObj((double) AuroraStrings::count(args[0].asStringUnchecked(), pattern));
+    }),
+    AURORA_FN("trim", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        return AuroraObj(std::string(AuroraStrings::trim(args[0].asStringUnchecked())));
+    }),
+    // regular expressions, taking a pattern string or a value from re_compile, see AuroraRegex
+    AURORA_FN("re_compile", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        return AuroraRegex::compile(args[0].asStringUnchecked());
+    }),
+    AURORA_FN("re_match", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 1);
+        return AuroraObj(AuroraRegex::of(args[0])->search(args[1].asStringUnchecked()));
+    }),
+    AURORA_FN("re_groups", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 1);
+        auto groups = AuroraRegex::of(args[0])->groups(args[1].asStringUnchecked());
+        return groups ? AuroraObj(std::move(*groups)) : AuroraObj();
+    }),
+    AURORA_FN("re_find_all", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 1);
+        return AuroraObj(AuroraRegex::of(args[0])->findAll(args[1].asStringUnchecked()));
+    }),
+    AURORA_FN("re_replace", {
+        if (args.size() != 3) throw AuroraException("Expected 3 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 1);
+        guardType(args[2].value.index(), 1);
+        return AuroraObj(AuroraRegex::of(args[0])->replace(args[1].asStringUnchecked(), args[2].asStringUnchecked()));
+    }),
+    AURORA_FN("re_split", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 1);
+        return AuroraObj(AuroraRegex::of(args[0])->split(args[1].asStringUnchecked()));
     }),
     AURORA_FN("empty?", {
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
-        return AuroraObj(str.empty());
+        return AuroraObj(args[0].asStringUnchecked().empty());
     }),
     AURORA_FN("to_string", {
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
         return AuroraObj(args[0].string_representation());
     }),
-    // input
+    // input, read from stdin through one shared buffer, see AuroraInput
     AURORA_FN("input", {
         if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
         std::string str;
-        std::getline(std::cin, str);
+        AuroraContext::running().output.beforeInput();
+        AuroraInput::standard().line(str);
         return AuroraObj(std::move(str));
     }),
     {"NaN", AuroraObj(std::numeric_limits<double>::quiet_NaN())},
     AURORA_FN("input_int", {
         if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
         std::string str;
-        std::getline(std::cin, str);
-        try {
-            return AuroraObj(std::stod(str));
-        } catch (std::invalid_argument &) {
-            return AuroraObj(std::numeric_limits<double>::quiet_NaN());
-        }
+        AuroraContext::running().output.beforeInput();
+        AuroraInput::standard().line(str);
+        return AuroraObj(AuroraInput::parseNumber(str));
     }),
     AURORA_FN("input_double", {
         if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
         std::string str;
-        std::getline(std::cin, str);
-        try {
-            return AuroraObj(std::stod(str));
-        } catch (std::invalid_argument &) {
-            return AuroraObj(std::numeric_limits<double>::quiet_NaN());
-        }
+        AuroraContext::running().output.beforeInput();
+        AuroraInput::standard().line(str);
+        return AuroraObj(AuroraInput::parseNumber(str));
     }),
     AURORA_FN("input_bool", {
         if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
         std::string str;
-        std::getline(std::cin, str);
+        AuroraContext::running().output.beforeInput();
+        AuroraInput::standard().line(str);
         if (str == "true") return AuroraObj(true);
         if (str == "false") return AuroraObj(false);
         return AuroraObj();
@@ -193,11 +272,10 @@ std::unordered_map<std::string, AuroraObj> globals = {
         // return true if it does, false if it doesn't, and nil if there is no more input
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
         std::string input;
-        std::cin >> input;
-        if (std::cin.eof()) return AuroraObj();
-        return AuroraObj(input == str);
+        AuroraContext::running().output.beforeInput();
+        if (!AuroraInput::standard().word(input)) return AuroraObj();
+        return AuroraObj(input == args[0].asStringUnchecked());
     }),
     AURORA_FN("read_delim?", {
         // test if stdin matches args[0]
@@ -206,12 +284,140 @@ std::unordered_map<std::string, AuroraObj> globals = {
         // return true if it does, false if it doesn't, and nil if there is no more input
         if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
         guardType(args[0].value.index(), 1);
-        std::string str = std::get<std::string>(args[0].value);
+        auto &str = args[0].asStringUnchecked();
+        if (str.empty()) throw AuroraException("Expected a delimiter, got an empty string.");
         std::string input;
-        std::getline(std::cin, input, str[0]);
-        if (std::cin.eof()) return AuroraObj();
+        AuroraContext::running().output.beforeInput();
+        if (!AuroraInput::standard().until(str[0], input)) return AuroraObj();
         return AuroraObj(input == str);
     }),
+    AURORA_FN("read_lines", {
+        if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraIterator::lines();
+    }),
+    AURORA_FN("read_all", {
+        if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+        AuroraContext::running().output.beforeInput();
+        return AuroraObj(AuroraInput::standard().all());
+    }),
+    AURORA_FN("read_numbers", {
+        if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+        AuroraContext::running().output.beforeInput();
+        return AuroraObj(AuroraList(AuroraInput::standard().numbers()));
+    }),
+    // files, mapped when read, see AuroraFile
+    AURORA_FN("read_file", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        return AuroraFile::read(args[0].asStringUnchecked());
+    }),
+    AURORA_FN("lines", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        return AuroraFile::lines(args[0].asStringUnchecked());
+    }),
+    AURORA_FN("write_file", {
+        if (args.empty()) throw AuroraException("Expected at least 1 argument, got 0.");
+        guardType(args[0].value.index(), 1);
+        AuroraFile::write(args[0].asStringUnchecked(), args, 1);
+        return AuroraObj();
+    }),
+    AURORA_FN("open", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 1);
+        return AuroraFile::open(args[0].asStringUnchecked());
+    }),
+    // tasks, green threads of the running script, see AuroraContext::spawn
+    AURORA_FN("spawn", {
+        return AuroraContext::running().spawn(args);
+    }),
+    AURORA_FN("await", {
+        return AuroraContext::running().await(args);
+    }),
+    AURORA_FN("yield", {
+        return AuroraContext::running().yield(args);
+    }),
+    // channels between tasks, and between scripts, see AuroraChannel
+    AURORA_FN("channel", {
+        if (!args.empty()) throw AuroraException("Expected 0 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraObj((double) AuroraChannel::open());
+    }),
+    AURORA_FN("send", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 0);
+        AuroraChannel::send(args[0].asDouble(), args[1]);
+        return AuroraObj();
+    }),
+    AURORA_FN("receive", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        guardType(args[0].value.index(), 0);
+        return AuroraContext::running().receive(args[0].asDouble());
+    }),
+    AURORA_FN("close", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        // file writers from open close here too
+        if (AuroraFile::close(args[0])) return AuroraObj();
+        guardType(args[0].value.index(), 0);
+        AuroraChannel::close(args[0].asDouble());
+        return AuroraObj();
+    }),
+    // hash maps, written {key -> value, ...}, see AuroraMap
+    AURORA_FN("get", {
+        if (args.size() < 2 || args.size() > 3) throw AuroraException("Expected 2 or 3 arguments, got " + std::to_string(args.size()) + ".");
+        auto found = AuroraMap::from(args[0]).get(args[1]);
+        if (found) return *found;
+        return args.size() == 3 ? args[2] : AuroraObj();
+    }),
+    AURORA_FN("set", {
+        if (args.size() != 3) throw AuroraException("Expected 3 arguments, got " + std::to_string(args.size()) + ".");
+        AuroraMap::from(args[0]).set(args[1], args[2]);
+        return AuroraObj();
+    }),
+    AURORA_FN("has?", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraObj(AuroraMap::from(args[0]).get(args[1]) != nullptr);
+    }),
+    AURORA_FN("delete", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraObj(AuroraMap::from(args[0]).erase(args[1]));
+    }),
+    AURORA_FN("keys", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        return AuroraObj(AuroraMap::from(args[0]).keys());
+    }),
+    AURORA_FN("values", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        return AuroraObj(AuroraMap::from(args[0]).values());
+    }),
+    // lazy iterators, pulled one element at a time by for and the adapters, see AuroraIterator
+    AURORA_FN("generator", {
+        return AuroraContext::running().generator(args);
+    }),
+    AURORA_FN("emit", {
+        return AuroraContext::running().emit(args);
+    }),
+    AURORA_FN("iterate", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        return AuroraIterator::make(AuroraIterator::over(args[0]));
+    }),
+    AURORA_FN("map", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraIterator::map(args[0], args[1]);
+    }),
+    AURORA_FN("filter", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        return AuroraIterator::filter(args[0], args[1]);
+    }),
+    AURORA_FN("take", {
+        if (args.size() != 2) throw AuroraException("Expected 2 arguments, got " + std::to_string(args.size()) + ".");
+        guardType(args[1].value.index(), 0);
+        if (args[1].asDouble() < 0) throw AuroraException("Can't take a negative count.");
+        return AuroraIterator::take(args[0], (size_t) args[1].asDouble());
+    }),
+    AURORA_FN("collect", {
+        if (args.size() != 1) throw AuroraException("Expected 1 argument, got " + std::to_string(args.size()) + ".");
+        return AuroraIterator::collect(args[0]);
+    }),
 
 };
 
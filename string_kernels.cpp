@@ -0,0 +1,115 @@
+#include "string_kernels.h"
+#include <cctype>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    using Kernel = size_t (*)(const char *text, size_t size, const char *pattern, size_t length);
+
+    size_t findScalar(const char *text, size_t size, const char *pattern, size_t length) {
+        return std::string_view(text, size).find(std::string_view(pattern, length));
+    }
+
+#if defined(__x86_64__)
+    // Candidates are positions whose first and last bytes both match the pattern's, tested a
+    // register's width at a time; only they get compared in full. Patterns are at least 2 bytes.
+    __attribute__((target("avx2")))
+    size_t findAvx2(const char *text, size_t size, const char *pattern, size_t length) {
+        const __m256i first = _mm256_set1_epi8(pattern[0]), last = _mm256_set1_epi8(pattern[length - 1]);
+        size_t i = 0;
+        for (; i + length - 1 + 32 <= size; i += 32) {
+            __m256i starts = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+            __m256i ends = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i + length - 1));
+            auto mask = (uint32_t) _mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(starts, first), _mm256_cmpeq_epi8(ends, last)));
+            while (mask) {
+                int bit = __builtin_ctz(mask);
+                if (std::memcmp(text + i + bit + 1, pattern + 1, length - 2) == 0) return i + bit;
+                mask &= mask - 1;
+            }
+        }
+        size_t rest = findScalar(text + i, size - i, pattern, length);
+        return rest == AuroraStrings::npos ? rest : i + rest;
+    }
+
+    size_t findSse2(const char *text, size_t size, const char *pattern, size_t length) {
+        const __m128i first = _mm_set1_epi8(pattern[0]), last = _mm_set1_epi8(pattern[length - 1]);
+        size_t i = 0;
+        for (; i + length - 1 + 16 <= size; i += 16) {
+            __m128i starts = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+            __m128i ends = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + length - 1));
+            auto mask = (uint32_t) _mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last)));
+            while (mask) {
+                int bit = __builtin_ctz(mask);
+                if (std::memcmp(text + i + bit + 1, pattern + 1, length - 2) == 0) return i + bit;
+                mask &= mask - 1;
+            }
+        }
+        size_t rest = findScalar(text + i, size - i, pattern, length);
+        return rest == AuroraStrings::npos ? rest : i + rest;
+    }
+#endif
+
+    Kernel pick() {
+#if defined(__x86_64__)
+        // SSE2 is part of x86-64
+        return __builtin_cpu_supports("avx2") ? findAvx2 : findSse2;
+#else
+        return findScalar;
+#endif
+    }
+}
+
+size_t AuroraStrings::find(std::string_view text, std::string_view pattern, size_t from) {
+    if (from > text.size()) return npos;
+    if (pattern.empty()) return from;
+    if (pattern.size() > text.size() - from) return npos;
+    if (pattern.size() == 1) {
+        auto found = static_cast<const char *>(std::memchr(text.data() + from, pattern[0], text.size() - from));
+        return found ? found - text.data() : npos;
+    }
+    static const Kernel kernel = pick();
+    size_t found = kernel(text.data() + from, text.size() - from, pattern.data(), pattern.size());
+    return found == npos ? npos : from + found;
+}
+
+size_t AuroraStrings::count(std::string_view text, std::string_view pattern) {
+    size_t count = 0;
+    for (size_t at = find(text, pattern); at != npos; at = find(text, pattern, at + pattern.size())) count++;
+    return count;
+}
+
+std::vector<AuroraObj> AuroraStrings::split(std::string_view text, std::string_view delimiter) {
+    std::vector<AuroraObj> pieces;
+    size_t start = 0;
+    for (size_t at = find(text, delimiter); at != npos; at = find(text, delimiter, start)) {
+        pieces.emplace_back(std::string(text.substr(start, at - start)));
+        start = at + delimiter.size();
+    }
+    pieces.emplace_back(std::string(text.substr(start)));
+    return pieces;
+}
+
+std::string AuroraStrings::replaceAll(std::string_view text, std::string_view from, std::string_view to) {
+    std::string result;
+    size_t start = 0;
+    for (size_t at = find(text, from); at != npos; at = find(text, from, start)) {
+        result.append(text.data() + start, at - start);
+        result.append(to);
+        start = at + from.size();
+    }
+    if (start == 0) return std::string(text);
+    result.append(text.data() + start, text.size() - start);
+    return result;
+}
+
+std::string_view AuroraStrings::trim(std::string_view text) {
+    size_t start = 0, end = text.size();
+    while (start < end && std::isspace((unsigned char) text[start])) start++;
+    while (end > start && std::isspace((unsigned char) text[end - 1])) end--;
+    return text.substr(start, end - start);
+}
@@ -0,0 +1,32 @@
+#ifndef AURORA_STRING_KERNELS_H
+#define AURORA_STRING_KERNELS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "aurora_obj.h"
+
+// Searching kernels behind the string builtins. Substring search tests 32 or 16 candidate positions
+// at once with AVX2 or SSE2, whichever the CPU has, falling back to scalar search elsewhere; single
+// bytes go to memchr, which libc already vectorizes. Everything borrows its arguments and makes one
+// pass over the text.
+struct AuroraStrings {
+    static constexpr size_t npos = std::string_view::npos;
+
+    // first occurrence of pattern at or after from, npos if there's none
+    static size_t find(std::string_view text, std::string_view pattern, size_t from = 0);
+
+    // non-overlapping occurrences of pattern, which mustn't be empty
+    static size_t count(std::string_view text, std::string_view pattern);
+
+    // the pieces between occurrences of delimiter, which mustn't be empty
+    static std::vector<AuroraObj> split(std::string_view text, std::string_view delimiter);
+
+    // text with every non-overlapping occurrence of from, which mustn't be empty, replaced by to
+    static std::string replaceAll(std::string_view text, std::string_view from, std::string_view to);
+
+    // text without leading and trailing whitespace
+    static std::string_view trim(std::string_view text);
+};
+
+#endif //AURORA_STRING_KERNELS_H
@@ -0,0 +1,90 @@
+#include "tracer.h"
+#include <iomanip>
+
+static const int allocationKinds[] = {1, 3, 4, 5, 8, 9};
+
+AuroraTracer::AuroraTracer() {
+    AuroraAllocations::enabled++;
+}
+
+AuroraTracer::~AuroraTracer() {
+    AuroraAllocations::enabled--;
+}
+
+void AuroraTracer::registerNatives(const std::unordered_map<std::string, AuroraObj> &globals) {
+    // every native is a distinct lambda, so its type identifies it even after the value is copied
+    for (const auto &[name, value]: globals) {
+        if (value.value.index() == 7) natives.emplace(std::get<AuroraNativeFunction>(value.value).target_type(), name);
+    }
+}
+
+const std::string &AuroraTracer::nativeName(const AuroraNativeFunction &fn) const {
+    static const std::string unknown = "<native>";
+    auto it = natives.find(fn.target_type());
+    return it == natives.end() ? unknown : it->second;
+}
+
+void AuroraTracer::begin(const std::string &name, const char *category) {
+    bool recorded = !truncated && open.size() < maxDepth;
+    // phases are always kept, calls are sampled
+    if (recorded && !open.empty() && sampleEvery > 1) recorded = calls++ % sampleEvery == 0;
+    open.push_back({recorded ? name : std::string(), category, recorded, recorded ? now() : 0});
+}
+
+void AuroraTracer::end() {
+    Span span = std::move(open.back());
+    open.pop_back();
+    if (!span.recorded || truncated) return;
+    double end = now();
+    events.push_back({std::move(span.name), span.category, 'X', span.start, end - span.start, {}});
+    allocationCounter(end);
+    if (events.size() >= maxEvents) truncated = true;
+}
+
+void AuroraTracer::allocationCounter(double timestamp) {
+    uint64_t allocated = 0;
+    for (int kind: allocationKinds) allocated += AuroraAllocations::bytes[kind].load();
+    if (allocated == lastAllocated) return;
+    lastAllocated = allocated;
+    Event event{"heap allocated bytes", "allocation", 'C', timestamp, 0, {}};
+    for (int kind: allocationKinds) event.args[kind] = AuroraAllocations::bytes[kind].load();
+    events.push_back(event);
+}
+
+static void writeString(std::ostream &out, const std::string &str) {
+    out << '"';
+    for (char c: str) {
+        if (c == '"' || c == '\\') out << '\\' << c;
+        else if ((unsigned char) c < 0x20) out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c
+                                               << std::dec << std::setfill(' ');
+        else out << c;
+    }
+    out << '"';
+}
+
+void AuroraTracer::write(std::ostream &out) const {
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"truncated\": " << (truncated ? "true" : "false")
+        << "}, \"traceEvents\": [\n";
+    out << R"(  {"name": "thread_name", "ph": "M", "pid": 1, "tid": 1, "args": {"name": "aurora"}})";
+    for (const auto &event: events) {
+        out << ",\n  {\"name\": ";
+        writeString(out, event.name);
+        out << ", \"cat\": \"" << event.category << "\", \"ph\": \"" << event.phase << "\", \"ts\": "
+            << event.timestamp << ", \"pid\": 1, \"tid\": 1";
+        if (event.phase == 'X') out << ", \"dur\": " << event.duration;
+        if (event.phase == 'C') {
+            out << ", \"args\": {";
+            bool first = true;
+            for (int kind: allocationKinds) {
+                out << (first ? "" : ", ") << '"' << variantIndexToString(kind) << "\": " << event.args[kind];
+                first = false;
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+}
@@ -0,0 +1,78 @@
+#ifndef AURORA_TRACER_H
+#define AURORA_TRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+#include "aurora_obj.h"
+
+// Records a timeline of compile phases, Aurora function calls and native calls as Chrome
+// trace-event JSON, viewable in Perfetto or chrome://tracing. Heap allocation totals are
+// recorded as a counter track alongside. Spans nested deeper than maxDepth aren't recorded,
+// only one in sampleEvery calls is, and recording stops after maxEvents events.
+class AuroraTracer {
+    struct Span {
+        std::string name; // only kept if recorded
+        const char *category;
+        bool recorded;
+        double start;
+    };
+
+    struct Event {
+        std::string name;
+        const char *category;
+        char phase;
+        double timestamp, duration; // microseconds
+        uint64_t args[AuroraAllocations::kinds]; // counters: allocated bytes by variant index
+    };
+
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::vector<Span> open;
+    std::vector<Event> events;
+    std::unordered_map<std::type_index, std::string> natives;
+    uint64_t calls = 0;
+    uint64_t lastAllocated = 0;
+    bool truncated = false;
+
+    [[nodiscard]] double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void allocationCounter(double timestamp);
+
+public:
+    size_t maxDepth = 64;
+    uint64_t sampleEvery = 1;
+    size_t maxEvents = 1'000'000;
+
+    // counts allocations for the counter track for as long as the tracer lives
+    AuroraTracer();
+
+    AuroraTracer(const AuroraTracer &) = delete;
+
+    ~AuroraTracer();
+
+    // learns the names of the natives in globals, so native calls can be labeled
+    void registerNatives(const std::unordered_map<std::string, AuroraObj> &globals);
+
+    [[nodiscard]] const std::string &nativeName(const AuroraNativeFunction &fn) const;
+
+    void begin(const std::string &name, const char *category);
+
+    void end();
+
+    [[nodiscard]] size_t depth() const { return open.size(); }
+
+    // ends spans left open by an exception
+    void unwind(size_t depth) {
+        while (open.size() > depth) end();
+    }
+
+    void write(std::ostream &out) const;
+};
+
+#endif //AURORA_TRACER_H
@@ -0,0 +1,586 @@
+#include "type_inference.h"
+#include <algorithm>
+
+std::string AuroraType::to_string() const {
+    if (kinds == 0) return "none";
+    if (kinds == ANY) return "any";
+    std::string result;
+    for (size_t i = 0; i < 16; i++) {
+        if (!may(i)) continue;
+        if (!result.empty()) result += "|";
+        result += variantIndexToString(i);
+        if (i == 3 && elements != 0 && elements != ANY) {
+            AuroraType element;
+            element.kinds = elements;
+            result += "<" + element.to_string() + ">";
+        }
+    }
+    return result;
+}
+
+void AuroraTypeInference::State::join(const State &other) {
+    if (!other.reachable) return;
+    if (!reachable) {
+        *this = other;
+        return;
+    }
+    if (stack.size() > other.stack.size()) stack.resize(other.stack.size());
+    for (size_t i = 0; i < stack.size(); i++) stack[i].join(other.stack[i]);
+    if (scopes.size() > other.scopes.size()) scopes.resize(other.scopes.size());
+    for (size_t i = 0; i < scopes.size(); i++) {
+        // a name bound on only one side is maybe-bound; loading it unbound throws, so its type still holds
+        for (const auto &[name, type]: other.scopes[i]) {
+            auto it = scopes[i].find(name);
+            if (it == scopes[i].end()) scopes[i].emplace(name, type);
+            else it->second.join(type);
+        }
+    }
+    for (const auto &[name, type]: other.globals) {
+        auto it = globals.find(name);
+        if (it == globals.end()) globals.emplace(name, type);
+        else it->second.join(type);
+    }
+}
+
+AuroraTypeInference::AuroraTypeInference(const std::unordered_map<std::string, AuroraObj> &globals) {
+    for (const auto &[name, value]: globals) {
+        AuroraType type = typeOf(value);
+        if (value.value.index() == 7) type.native = name;
+        initialGlobals.emplace(name, type);
+    }
+    globalSummary = initialGlobals;
+}
+
+AuroraType AuroraTypeInference::typeOf(const AuroraObj &obj) {
+    AuroraType type = AuroraType::of(obj.value.index());
+    if (obj.value.index() == 3) {
+        auto &list = obj.asListUnchecked();
+        if (list.packed()) type.elements = list.empty() ? 0 : 1 << 0;
+        else for (const auto &element: list.values()) type.elements |= 1 << element.value.index();
+    }
+    return type;
+}
+
+// result types of the std_lib natives, keyed by their global name
+AuroraType AuroraTypeInference::nativeResult(const std::string &name, const std::vector<AuroraType> &args) {
+    static const std::unordered_map<std::string, AuroraType> results = {
+            {"print",        AuroraType::of(6)},
+            {"write",        AuroraType::of(6)},
+            {"writeln",      AuroraType::of(6)},
+            {"flush",        AuroraType::of(6)},
+            {"size",         AuroraType::of(0)},
+            {"set",          AuroraType::of(6)},
+            {"has?",         AuroraType::of(2)},
+            {"delete",       AuroraType::of(2)},
+            {"keys",         AuroraType::list((1 << 0) | (1 << 1) | (1 << 2))},
+            {"values",       AuroraType::list(AuroraType::ANY)},
+            {"range",        AuroraType::list(1 << 0)},
+            {"split",        AuroraType::list(1 << 1)},
+            {"join",         AuroraType::of(1)},
+            {"format",       AuroraType::of(1)},
+            {"replace",      AuroraType::of(1)},
+            {"replace_all",  AuroraType::of(1)},
+            {"count",        AuroraType::of(0)},
+            {"trim",         AuroraType::of(1)},
+            {"re_compile",   AuroraType::of(7)},
+            {"re_match",     AuroraType::of(2)},
+            {"re_find_all",  AuroraType::list(1 << 1)},
+            {"re_replace",   AuroraType::of(1)},
+            {"re_split",     AuroraType::list(1 << 1)},
+            {"substr",       AuroraType::of(1)},
+            {"find",         AuroraType::of(0)},
+            {"find_last",    AuroraType::of(0)},
+            {"contains?",    AuroraType::of(2)},
+            {"empty?",       AuroraType::of(2)},
+            {"to_string",    AuroraType::of(1)},
+            {"input",        AuroraType::of(1)},
+            {"input_int",    AuroraType::of(0)},
+            {"input_double", AuroraType::of(0)},
+            {"spawn",        AuroraType::of(0)},
+            {"yield",        AuroraType::of(6)},
+            {"channel",      AuroraType::of(0)},
+            {"send",         AuroraType::of(6)},
+            {"close",        AuroraType::of(6)},
+            {"generator",    AuroraType::of(10)},
+            {"emit",         AuroraType::of(6)},
+            {"iterate",      AuroraType::of(10)},
+            {"map",          AuroraType::of(10)},
+            {"filter",       AuroraType::of(10)},
+            {"take",         AuroraType::of(10)},
+            {"read_lines",   AuroraType::of(10)},
+            {"read_all",     AuroraType::of(1)},
+            {"read_numbers", AuroraType::list(1 << 0)},
+            {"read_file",    AuroraType::of(1)},
+            {"lines",        AuroraType::of(10)},
+            {"write_file",   AuroraType::of(6)},
+            {"open",         AuroraType::of(7)},
+            {"collect",      AuroraType::list(AuroraType::ANY)},
+    };
+    if (name == "push_back" || name == "pop_back") {
+        AuroraType type = AuroraType::list(0);
+        if (!args.empty()) type.elements = args[0].elements;
+        if (name == "push_back" && args.size() > 1) type.elements |= args[1].kinds;
+        return type;
+    }
+    if (name == "input_bool" || name == "read?" || name == "read_delim?") {
+        AuroraType type = AuroraType::of(2);
+        type.join(AuroraType::of(6));
+        return type;
+    }
+    auto it = results.find(name);
+    if (it != results.end()) return it->second;
+    return AuroraType::any();
+}
+
+AuroraType AuroraTypeInference::pop(State &state) {
+    if (state.stack.empty()) return AuroraType::any();
+    AuroraType type = state.stack.back();
+    state.stack.pop_back();
+    return type;
+}
+
+void AuroraTypeInference::record(const std::string &path, AuroraCodeUnit &unit, int pc, const AuroraType &a,
+                                 const AuroraType &b) {
+    auto it = sites.find(&unit.instructions[pc]);
+    if (it == sites.end()) {
+        sites.emplace(&unit.instructions[pc], Site{path, pc, unit.instructions[pc].type, a, b});
+    } else {
+        it->second.a.join(a);
+        it->second.b.join(b);
+    }
+}
+
+AuroraType AuroraTypeInference::lookup(const State &state, const std::string &name) const {
+    for (int i = state.scopes.size() - 1; i >= 0; i--) {
+        auto it = state.scopes[i].find(name);
+        if (it != state.scopes[i].end()) return it->second;
+    }
+    auto it = state.globals.find(name);
+    if (it != state.globals.end()) return it->second;
+    return AuroraType::any();
+}
+
+// mirrors AuroraContext::setVariable
+void AuroraTypeInference::store(State &state, const std::string &name, const AuroraType &type) {
+    const AuroraType &stored = type;
+    for (int i = state.scopes.size() - 1; i >= 0; i--) {
+        auto it = state.scopes[i].find(name);
+        if (it != state.scopes[i].end()) {
+            it->second = stored;
+            return;
+        }
+    }
+    if (state.scopes.empty() || (!inFunction && state.globals.count(name))) {
+        state.globals[name] = stored;
+        auto it = globalSummary.find(name);
+        if (it == globalSummary.end()) globalSummary.emplace(name, stored);
+        else it->second.join(stored);
+        return;
+    }
+    state.scopes.back()[name] = stored;
+}
+
+void AuroraTypeInference::analyze(const std::string &path, AuroraCodeUnit &unit, State &state, Exits *exits) {
+    // jumps only go forward, so every state flowing into a target is known by the time it's reached
+    std::unordered_map<int, State> pending;
+    State exit;
+    exit.reachable = false;
+    auto jump = [&](int target, const State &from) {
+        auto it = pending.find(target);
+        if (it == pending.end()) pending.emplace(target, from);
+        else it->second.join(from);
+    };
+    for (int pc = 0; pc < (int) unit.instructions.size(); pc++) {
+        auto it = pending.find(pc);
+        if (it != pending.end()) {
+            state.join(it->second);
+            pending.erase(it);
+        }
+        if (!state.reachable) continue;
+        auto &instruction = unit.instructions[pc];
+        switch (instruction.type) {
+            case InstructionType::PUSH: {
+                auto &constant = unit.constants[instruction.operand];
+                AuroraType type = typeOf(constant);
+                if (constant.value.index() == 4) {
+                    auto &function = std::get<AuroraFunction>(constant.value);
+                    pendingFunctions.emplace_back("fn " + function.name, &function);
+                }
+                state.stack.push_back(type);
+                break;
+            }
+            case InstructionType::PUSHI:
+                state.stack.push_back(AuroraType::of(0));
+                break;
+            case InstructionType::TRUE:
+            case InstructionType::FALSE:
+                state.stack.push_back(AuroraType::of(2));
+                break;
+            case InstructionType::POP:
+                pop(state);
+                break;
+            case InstructionType::ADD: {
+                AuroraType b = pop(state), a = pop(state);
+                record(path, unit, pc, a, b);
+                AuroraType result;
+                if (a.may(0) && b.may(0)) result.join(AuroraType::of(0));
+                if (a.may(1) && b.may(1)) result.join(AuroraType::of(1));
+                state.stack.push_back(result.kinds ? result : AuroraType::any());
+                break;
+            }
+            case InstructionType::SUB:
+            case InstructionType::MUL:
+            case InstructionType::DIV:
+            case InstructionType::MOD:
+            case InstructionType::EQ:
+            case InstructionType::NEQ:
+            case InstructionType::LT:
+            case InstructionType::GT:
+            case InstructionType::LTE:
+            case InstructionType::GTE: {
+                AuroraType b = pop(state), a = pop(state);
+                record(path, unit, pc, a, b);
+                bool arithmetic = instruction.type == InstructionType::SUB || instruction.type == InstructionType::MUL
+                                  || instruction.type == InstructionType::DIV ||
+                                  instruction.type == InstructionType::MOD;
+                state.stack.push_back(AuroraType::of(arithmetic ? 0 : 2));
+                break;
+            }
+            case InstructionType::NEG:
+            case InstructionType::NOT: {
+                AuroraType a = pop(state);
+                record(path, unit, pc, a);
+                state.stack.push_back(AuroraType::of(instruction.type == InstructionType::NEG ? 0 : 2));
+                break;
+            }
+            case InstructionType::CALL: {
+                std::vector<AuroraType> args(instruction.operand);
+                for (int i = instruction.operand - 1; i >= 0; i--) args[i] = pop(state);
+                AuroraType callee = pop(state);
+                record(path, unit, pc, callee);
+                if (callee.is(7) && !callee.native.empty()) state.stack.push_back(nativeResult(callee.native, args));
+                else state.stack.push_back(AuroraType::any());
+                break;
+            }
+            case InstructionType::TAILCALL:
+                for (int i = 0; i <= instruction.operand; i++) pop(state);
+                state.stack.push_back(AuroraType::any());
+                break;
+            case InstructionType::RET:
+                state.reachable = false;
+                break;
+            case InstructionType::RES:
+                pop(state);
+                exit.join(state);
+                state.reachable = false;
+                break;
+            case InstructionType::JMP:
+                jump(instruction.operand, state);
+                state.reachable = false;
+                break;
+            case InstructionType::JMPF:
+            case InstructionType::JMPT:
+                pop(state);
+                jump(instruction.operand, state);
+                break;
+            case InstructionType::BLOCK:
+                analyzeBlock(path + " > block", unit, instruction.operand, state, exits);
+                break;
+            case InstructionType::LOAD:
+                state.stack.push_back(lookup(state, unit.constants[instruction.operand].asString()));
+                break;
+            case InstructionType::STORE:
+                store(state, unit.constants[instruction.operand].asString(), pop(state));
+                break;
+            case InstructionType::APPEND: {
+                auto &target = unit.constants[instruction.operand].asListUnchecked().values();
+                auto &name = target[0].asStringUnchecked();
+                AuroraType result = lookup(state, name);
+                for (int i = 0; i < (int) target[1].asDouble(); i++) {
+                    AuroraType b = pop(state), sum;
+                    if (result.may(0) && b.may(0)) sum.join(AuroraType::of(0));
+                    if (result.may(1) && b.may(1)) sum.join(AuroraType::of(1));
+                    result = sum.kinds ? sum : AuroraType::any();
+                }
+                store(state, name, result);
+                break;
+            }
+            // fields can hold anything, and records stay where they are when one is stored
+            case InstructionType::GET_FIELD:
+                pop(state);
+                state.stack.push_back(AuroraType::any());
+                break;
+            case InstructionType::SET_FIELD:
+                pop(state);
+                pop(state);
+                break;
+            case InstructionType::LOAD_FIELD:
+                state.stack.push_back(AuroraType::any());
+                break;
+            case InstructionType::STORE_FIELD:
+                pop(state);
+                break;
+            case InstructionType::IF:
+                analyzeIf(path, unit, instruction.operand, state, exits);
+                break;
+            case InstructionType::WLOOP:
+                analyzeWhile(path, unit, instruction.operand, state);
+                break;
+            case InstructionType::FLOOP:
+                analyzeFor(path, unit, instruction.operand, state);
+                break;
+            case InstructionType::IDX:
+            case InstructionType::LOAD_IDX:
+            case InstructionType::LOAD_ENTRY: {
+                AuroraType a = pop(state);
+                AuroraType b = instruction.type == InstructionType::IDX
+                               ? pop(state) : lookup(state, unit.constants[instruction.operand].asString());
+                if (instruction.type == InstructionType::IDX) record(path, unit, pc, b, a);
+                AuroraType result;
+                if (b.may(3)) result.kinds |= b.elements ? b.elements : AuroraType::ANY;
+                if (b.may(1)) result.join(AuroraType::of(1));
+                // a map entry could be anything
+                if (b.may(8)) result.kinds = AuroraType::ANY;
+                if (result.kinds == AuroraType::ANY || result.kinds == 0) result = AuroraType::any();
+                state.stack.push_back(result);
+                break;
+            }
+            case InstructionType::SETIDX: {
+                AuroraType a = pop(state), c = pop(state);
+                pop(state);
+                AuroraType result;
+                if (a.may(3)) result.join(AuroraType::list(a.elements | c.kinds));
+                if (a.may(1)) result.join(AuroraType::of(1));
+                if (a.may(8)) result.join(AuroraType::of(8));
+                state.stack.push_back(result.kinds ? result : AuroraType::any());
+                break;
+            }
+            case InstructionType::BREAK:
+            case InstructionType::CONTINUE:
+                if (exits) {
+                    State exit = state;
+                    exit.stack.clear();
+                    exit.scopes.resize(exits->depth);
+                    (instruction.type == InstructionType::BREAK ? exits->breaks : exits->continues).join(exit);
+                }
+                state.reachable = false;
+                break;
+            case InstructionType::DUP:
+                state.stack.push_back(state.stack.empty() ? AuroraType::any() : state.stack.back());
+                break;
+            case InstructionType::MAP:
+                for (int i = 0; i < 2 * instruction.operand; i++) pop(state);
+                state.stack.push_back(AuroraType::of(8));
+                break;
+            case InstructionType::LIST: {
+                AuroraType result = AuroraType::list(0);
+                for (int i = 0; i < instruction.operand; i++) result.elements |= pop(state).kinds;
+                state.stack.push_back(result);
+                break;
+            }
+            case InstructionType::END:
+                exit.join(state);
+                state.reachable = false;
+                break;
+            default:
+                // already typed, nothing to prove
+                break;
+        }
+    }
+    auto it = pending.find(unit.instructions.size());
+    if (it != pending.end()) state.join(it->second);
+    exit.join(state);
+    state = exit;
+}
+
+void AuroraTypeInference::analyzeBlock(const std::string &path, AuroraCodeUnit &unit, int block, State &state,
+                                       Exits *exits) {
+    auto stack = state.stack;
+    state.stack.clear();
+    state.scopes.emplace_back();
+    analyze(path, std::get<AuroraCodeUnit>(unit.constants[block].value), state, exits);
+    if (state.reachable) state.scopes.pop_back();
+    state.stack = stack;
+}
+
+void AuroraTypeInference::analyzeIf(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state,
+                                    Exits *exits) {
+    pop(state);
+    State thenState = state, elseState = state;
+    analyzeBlock(path + " > if", unit, blocks, thenState, exits);
+    analyzeBlock(path + " > else", unit, blocks + 1, elseState, exits);
+    thenState.join(elseState);
+    state = thenState;
+}
+
+void AuroraTypeInference::analyzeWhile(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state) {
+    auto &cond = std::get<AuroraCodeUnit>(unit.constants[blocks].value);
+    auto &body = std::get<AuroraCodeUnit>(unit.constants[blocks + 1].value);
+    auto stack = state.stack;
+    State head = state;
+    head.stack.clear();
+    head.scopes.emplace_back();
+    State exit;
+    exit.reachable = false;
+    while (true) {
+        State iteration = head;
+        analyze(path + " > while", cond, iteration, nullptr);
+        iteration.stack.clear();
+        exit = iteration;
+        Exits exits;
+        exits.depth = head.scopes.size();
+        exits.breaks.reachable = exits.continues.reachable = false;
+        analyze(path + " > while", body, iteration, &exits);
+        iteration.join(exits.continues);
+        iteration.stack.clear();
+        if (iteration.reachable) iteration.scopes.back().clear();
+        exit.join(exits.breaks);
+        State next = head;
+        next.join(iteration);
+        if (next == head) break;
+        head = next;
+    }
+    state = exit;
+    if (state.reachable) state.scopes.pop_back();
+    state.stack = stack;
+}
+
+void AuroraTypeInference::analyzeFor(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state) {
+    auto &body = std::get<AuroraCodeUnit>(unit.constants[blocks].value);
+    auto &name = std::get<std::string>(unit.constants[blocks + 1].value);
+    AuroraType iter = pop(state);
+    AuroraType element;
+    if (iter.may(3)) element.kinds |= iter.elements ? iter.elements : AuroraType::ANY;
+    if (iter.may(1)) element.join(AuroraType::of(1));
+    // only lists and strings have known elements, iterators yield whatever their source does
+    if (iter.kinds & ~(1 << 1 | 1 << 3)) element.kinds = AuroraType::ANY;
+    if (element.kinds == AuroraType::ANY || element.kinds == 0) element = AuroraType::any();
+    auto stack = state.stack;
+    State head = state;
+    head.stack.clear();
+    head.scopes.emplace_back();
+    head.scopes.back()[name] = element;
+    State exit;
+    exit.reachable = false;
+    while (true) {
+        State iteration = head;
+        Exits exits;
+        exits.depth = head.scopes.size();
+        exits.breaks.reachable = exits.continues.reachable = false;
+        analyze(path + " > for " + name, body, iteration, &exits);
+        iteration.join(exits.continues);
+        iteration.stack.clear();
+        if (iteration.reachable) {
+            iteration.scopes.back().clear();
+            iteration.scopes.back()[name] = element;
+        }
+        exit.join(exits.breaks);
+        State next = head;
+        next.join(iteration);
+        if (next == head) break;
+        head = next;
+    }
+    exit.join(head);
+    state = exit;
+    if (state.reachable) state.scopes.pop_back();
+    state.stack = stack;
+}
+
+void AuroraTypeInference::run(AuroraCodeUnit &main) {
+    State state;
+    state.globals = initialGlobals;
+    analyze("<main>", main, state, nullptr);
+    // globals are only written by top level code, so every function sees the summary of those writes
+    inFunction = true;
+    std::vector<AuroraCodeUnit *> done;
+    while (!pendingFunctions.empty()) {
+        auto [path, function] = pendingFunctions.front();
+        pendingFunctions.pop_front();
+        if (std::find(done.begin(), done.end(), function->code.get()) != done.end()) continue;
+        done.push_back(function->code.get());
+        State fnState;
+        fnState.globals = globalSummary;
+        fnState.scopes.emplace_back();
+        for (const auto &parameter: function->parameters) fnState.scopes.back()[parameter] = AuroraType::any();
+        analyze(path, *function->code, fnState, nullptr);
+    }
+    rewrite();
+}
+
+void AuroraTypeInference::rewrite() {
+    std::vector<const Site *> dynamic;
+    for (auto &[instruction, site]: sites) {
+        const AuroraType &a = site.a, &b = site.b;
+        bool numbers = a.is(0) && b.is(0);
+        InstructionType typed = instruction->type;
+        switch (instruction->type) {
+            case InstructionType::ADD:
+                if (numbers) typed = InstructionType::ADD_NUM;
+                else if (a.is(1) && b.is(1)) typed = InstructionType::ADD_STR;
+                break;
+            case InstructionType::SUB:
+                if (numbers) typed = InstructionType::SUB_NUM;
+                break;
+            case InstructionType::MUL:
+                if (numbers) typed = InstructionType::MUL_NUM;
+                break;
+            case InstructionType::DIV:
+                if (numbers) typed = InstructionType::DIV_NUM;
+                break;
+            case InstructionType::MOD:
+                if (numbers) typed = InstructionType::MOD_NUM;
+                break;
+            case InstructionType::NEG:
+                if (a.is(0)) typed = InstructionType::NEG_NUM;
+                break;
+            case InstructionType::NOT:
+                if (a.is(2)) typed = InstructionType::NOT_BOOL;
+                break;
+            case InstructionType::EQ:
+                if (numbers) typed = InstructionType::EQ_NUM;
+                break;
+            case InstructionType::NEQ:
+                if (numbers) typed = InstructionType::NEQ_NUM;
+                break;
+            case InstructionType::LT:
+                if (numbers) typed = InstructionType::LT_NUM;
+                break;
+            case InstructionType::GT:
+                if (numbers) typed = InstructionType::GT_NUM;
+                break;
+            case InstructionType::LTE:
+                if (numbers) typed = InstructionType::LTE_NUM;
+                break;
+            case InstructionType::GTE:
+                if (numbers) typed = InstructionType::GTE_NUM;
+                break;
+            case InstructionType::IDX:
+                if (a.is(3) && b.is(0)) typed = InstructionType::IDX_LIST;
+                else if (a.is(1) && b.is(0)) typed = InstructionType::IDX_STR;
+                break;
+            case InstructionType::CALL:
+                if (a.is(4)) typed = InstructionType::CALL_FN;
+                else if (a.is(7)) typed = InstructionType::CALL_NATIVE;
+                break;
+            default:
+                break;
+        }
+        if (typed == instruction->type) dynamic.push_back(&site);
+        instruction->type = typed;
+    }
+    std::sort(dynamic.begin(), dynamic.end(), [](const Site *a, const Site *b) {
+        return a->path != b->path ? a->path < b->path : a->pc < b->pc;
+    });
+    dynamicSites.clear();
+    for (auto site: dynamic) {
+        std::string operands = site->a.to_string();
+        if (site->b.kinds) operands += ", " + site->b.to_string();
+        dynamicSites.push_back(site->path + " [" + std::to_string(site->pc) + "] " +
+                               instructionTypeToString(site->type) + " (" + operands + ")");
+    }
+}
+
+void AuroraTypeInference::report(std::ostream &out) const {
+    out << dynamicSites.size() << " dynamic site" << (dynamicSites.size() == 1 ? "" : "s") << "\n";
+    for (const auto &site: dynamicSites) out << "  " << site << "\n";
+}
@@ -0,0 +1,116 @@
+#ifndef AURORA_TYPE_INFERENCE_H
+#define AURORA_TYPE_INFERENCE_H
+
+#include <unordered_map>
+#include <deque>
+#include <ostream>
+#include "aurora_obj.h"
+
+// set of possible AuroraObj::value indices, one bit per index
+struct AuroraType {
+    uint16_t kinds = 0;
+    uint16_t elements = 0; // kinds of the elements, if this may be a list
+    std::string native; // std_lib name, if this is known to be that builtin
+
+    static constexpr uint16_t ANY = 0xFFFF;
+
+    static AuroraType of(size_t index) { AuroraType type; type.kinds = 1 << index; return type; }
+
+    static AuroraType any() { AuroraType type; type.kinds = ANY; type.elements = ANY; return type; }
+
+    static AuroraType list(uint16_t elements) { AuroraType type = of(3); type.elements = elements; return type; }
+
+    [[nodiscard]] bool is(size_t index) const { return kinds == 1 << index; }
+
+    [[nodiscard]] bool may(size_t index) const { return kinds & 1 << index; }
+
+    void join(const AuroraType &other) {
+        kinds |= other.kinds;
+        elements |= other.elements;
+        if (native != other.native) native.clear();
+    }
+
+    bool operator==(const AuroraType &other) const {
+        return kinds == other.kinds && elements == other.elements && native == other.native;
+    }
+
+    [[nodiscard]] std::string to_string() const;
+};
+
+// Flow-sensitive type inference over compiled code. Operand types are proven by abstractly
+// executing each code unit, and checked opcodes are rewritten to their typed, unchecked
+// variants wherever every execution is known to see the expected types.
+class AuroraTypeInference {
+    struct State {
+        bool reachable = true;
+        std::vector<AuroraType> stack;
+        std::vector<std::unordered_map<std::string, AuroraType>> scopes;
+        std::unordered_map<std::string, AuroraType> globals;
+
+        void join(const State &other);
+
+        bool operator==(const State &other) const {
+            return reachable == other.reachable && stack == other.stack && scopes == other.scopes &&
+                   globals == other.globals;
+        }
+    };
+
+    struct Exits {
+        size_t depth; // scopes up to and including the loop's own
+        State breaks;
+        State continues;
+    };
+
+    struct Site {
+        std::string path;
+        int pc;
+        InstructionType type;
+        AuroraType a, b;
+    };
+
+    std::unordered_map<Instruction *, Site> sites;
+    std::unordered_map<std::string, AuroraType> initialGlobals;
+    // every type a global is assigned by top level code, as seen from inside functions
+    std::unordered_map<std::string, AuroraType> globalSummary;
+    std::deque<std::pair<std::string, AuroraFunction *>> pendingFunctions;
+    bool inFunction = false;
+
+    static AuroraType typeOf(const AuroraObj &obj);
+
+    static AuroraType nativeResult(const std::string &name, const std::vector<AuroraType> &args);
+
+    static AuroraType pop(State &state);
+
+    void record(const std::string &path, AuroraCodeUnit &unit, int pc, const AuroraType &a,
+                const AuroraType &b = {});
+
+    AuroraType lookup(const State &state, const std::string &name) const;
+
+    void store(State &state, const std::string &name, const AuroraType &type);
+
+    // leaves state as the join of every way out of the unit
+    void analyze(const std::string &path, AuroraCodeUnit &unit, State &state, Exits *exits);
+
+    void analyzeBlock(const std::string &path, AuroraCodeUnit &unit, int block, State &state, Exits *exits);
+
+    // blocks is the constant index of the instruction's first code unit
+    void analyzeIf(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state, Exits *exits);
+
+    void analyzeWhile(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state);
+
+    void analyzeFor(const std::string &path, AuroraCodeUnit &unit, int blocks, State &state);
+
+    void rewrite();
+
+public:
+    explicit AuroraTypeInference(const std::unordered_map<std::string, AuroraObj> &globals);
+
+    void run(AuroraCodeUnit &main);
+
+    // checked sites the pass could not prove, as "<path> [pc] OPCODE (operand types)"
+    std::vector<std::string> dynamicSites;
+
+    void report(std::ostream &out) const;
+};
+
+#endif //AURORA_TYPE_INFERENCE_H